@@ -0,0 +1,371 @@
+// Headless simulation benchmark. Runs the simulation and the CPU side of the
+// render pass without a window at a fixed seed and timestep and reports
+// per-frame timings, heap allocations and a hash of the final particle state
+// as JSON. The hash only depends on the seed, dt and frame counts.
+//
+//   fireworks_bench [--scenario small|medium|large|stress|all] [--fireworks N]
+//                   [--frames N] [--warmup N] [--dt SECONDS] [--seed N]
+//                   [--threads N] [--particle-capacity N] [--output FILE]
+//                   [--trace FILE] [--config FILE] [--trail-detail FRACTION]
+//                   [--history FILE] [--particle-bytes N]
+//
+// The stress scenario keeps over a million particles live. Every scenario
+// reports its memory footprint, update throughput and the rate instance data
+// is gathered into host memory. That is CPU throughput only: no GPU is
+// involved, so it is not upload bandwidth, which the viewer's --stress stats
+// line reports. --history appends one JSON line per scenario to FILE
+// so these can be tracked over runs. --particle-bytes caps the storage of a
+// particle, switching to 16-bit life and then to the compact layout when the
+// full one does not fit.
+//
+// --config loads firework types from an INI file; without --scenario or
+// --fireworks it then runs the firework count given in the file.
+// --trail-detail fixes the trail level of detail, as a TrailLod would set it.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "firework_config.h"
+#include "instances.h"
+#include "integrate.h"
+#include "simulation.h"
+#include "trace.h"
+#include "trail_lod.h"
+
+using namespace std;
+
+// every heap allocation made by the process, so the per-frame passes can be
+// checked to stay allocation free
+atomic<size_t> numAllocations{0};
+
+void *operator new(size_t size) {
+    ++numAllocations;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+struct Scenario {
+    string name;
+    int numFireworks;
+    float staggerSeconds = 0; // spread of the fireworks' starting points, see Simulation::stagger()
+};
+
+const Scenario SCENARIOS[] = {
+    {"small", 10},
+    {"medium", 1000},
+    {"large", 100000}, // ~4 GB of particle storage
+    {"stress", STRESS_FIREWORKS, STRESS_STAGGER_SECONDS}, // over a million live particles
+};
+
+struct Options {
+    vector<Scenario> scenarios;
+    int frames = 600;
+    int warmup = 60;
+    float dt = 1.0f / 60.0f;
+    uint32_t seed = 1;
+    int threads = 0;
+    size_t particleCapacity = 0;
+    string output;
+    string trace; // Chrome trace-event JSON of every scenario
+    string configFile;
+    FireworkConfig config;
+    float trailDetail = 1.f;
+    string history; // JSON lines, appended to
+    size_t particleBytes = 0;
+};
+
+struct Result {
+    Scenario scenario;
+    int threads;
+    double meanMs, p50Ms, p99Ms, maxMs;
+    double instancesMeanMs;
+    double allocationsPerFrame;
+    double meanLiveParticles;
+    size_t minLiveParticles;
+    size_t memoryBytes;
+    double bytesPerParticle;
+    double instanceBytesPerFrame; // instance data written for the visible particles
+    double instanceGatherGBPerSecond; // rate buildInstances writes it to host memory
+    double particlesPerSecond;
+    uint64_t stateHash;
+};
+
+double percentile(const vector<double> &sorted, double p) {
+    size_t index = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+// FNV-1a over the live particles of every firework in firework order, so runs
+// can be compared whatever blocks the fireworks ended up in
+uint64_t stateHash(const Simulation &simulation) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    };
+
+    const ParticleSystem &ps = simulation.particles;
+    for (const Firework &firework : simulation.fireworks) {
+        if (firework.first == ParticlePool::NO_BLOCK) continue;
+        size_t count = firework.numLive();
+        add(&ps.posX[firework.first], count * sizeof(float));
+        add(&ps.posY[firework.first], count * sizeof(float));
+        add(&ps.alpha[firework.first], count * sizeof(uint8_t));
+    }
+    return hash;
+}
+
+// false if the scenario's particles do not fit
+bool runScenario(const Scenario &scenario, const Options &options, Result &result) {
+    FireworkConfig config = options.config;
+    config.numFireworks = scenario.numFireworks;
+    Simulation simulation;
+    if (!simulation.init(config, options.threads, options.particleCapacity, options.seed, options.particleBytes)) return false;
+    simulation.trailDetail = options.trailDetail;
+    if (scenario.staggerSeconds > 0) simulation.stagger(scenario.staggerSeconds, options.dt);
+
+    vector<ParticleInstance> instances(simulation.particles.size());
+    for (int i = 0; i < options.warmup; ++i) {
+        simulation.update(options.dt);
+        buildInstances(simulation, instances.data());
+    }
+
+    vector<double> frameMs;
+    frameMs.reserve(options.frames);
+    double totalLive = 0;
+    size_t minLive = SIZE_MAX;
+    double totalInstances = 0;
+    double totalInstancesMs = 0;
+    size_t allocationsBefore = numAllocations;
+
+    for (int i = 0; i < options.frames; ++i) {
+        auto start = chrono::steady_clock::now();
+        simulation.update(options.dt);
+        auto updated = chrono::steady_clock::now();
+        size_t numInstances = buildInstances(simulation, instances.data(), 1.0f, simulation.bounds);
+        auto end = chrono::steady_clock::now();
+        size_t live = simulation.numLiveParticles();
+        totalLive += live;
+        minLive = min(minLive, live);
+        totalInstances += numInstances;
+
+        frameMs.push_back(chrono::duration<double, milli>(updated - start).count());
+        totalInstancesMs += chrono::duration<double, milli>(end - updated).count();
+    }
+
+    size_t allocations = numAllocations - allocationsBefore;
+
+    double totalMs = 0;
+    for (double ms : frameMs) totalMs += ms;
+    sort(frameMs.begin(), frameMs.end());
+
+    result.scenario = scenario;
+    result.threads = simulation.threads->numThreads();
+    result.meanMs = totalMs / options.frames;
+    result.p50Ms = percentile(frameMs, 0.50);
+    result.p99Ms = percentile(frameMs, 0.99);
+    result.maxMs = frameMs.back();
+    result.instancesMeanMs = totalInstancesMs / options.frames;
+    result.allocationsPerFrame = (double) allocations / options.frames;
+    result.meanLiveParticles = totalLive / options.frames;
+    result.minLiveParticles = minLive;
+    result.memoryBytes = simulation.memoryBytes();
+    result.bytesPerParticle = simulation.particles.bytesPerParticle();
+    result.instanceBytesPerFrame = totalInstances * sizeof(ParticleInstance) / options.frames;
+    result.instanceGatherGBPerSecond = totalInstancesMs > 0 ? totalInstances * sizeof(ParticleInstance) / (totalInstancesMs / 1000.0) / 1e9 : 0;
+    result.particlesPerSecond = totalMs > 0 ? totalLive / (totalMs / 1000.0) : 0;
+    result.stateHash = stateHash(simulation);
+    return true;
+}
+
+void writeJson(FILE *out, const Options &options, const vector<Result> &results) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"seed\": %u,\n", options.seed);
+    fprintf(out, "  \"dt\": %.9g,\n", options.dt);
+    fprintf(out, "  \"frames\": %d,\n", options.frames);
+    fprintf(out, "  \"warmup\": %d,\n", options.warmup);
+    fprintf(out, "  \"kernel\": \"%s\",\n", integrateKernelName(integrateKernel()));
+    fprintf(out, "  \"config\": \"%s\",\n", options.configFile.c_str());
+    fprintf(out, "  \"trail_detail\": %.3f,\n", options.trailDetail);
+    fprintf(out, "  \"scenarios\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"name\": \"%s\",\n", r.scenario.name.c_str());
+        fprintf(out, "      \"fireworks\": %d,\n", r.scenario.numFireworks);
+        fprintf(out, "      \"threads\": %d,\n", r.threads);
+        fprintf(out, "      \"live_particles\": %.1f,\n", r.meanLiveParticles);
+        fprintf(out, "      \"live_particles_min\": %zu,\n", r.minLiveParticles);
+        fprintf(out, "      \"memory_mb\": %.1f,\n", r.memoryBytes / 1e6);
+        fprintf(out, "      \"bytes_per_particle\": %.2f,\n", r.bytesPerParticle);
+        fprintf(out, "      \"update_ms_mean\": %.6f,\n", r.meanMs);
+        fprintf(out, "      \"update_ms_p50\": %.6f,\n", r.p50Ms);
+        fprintf(out, "      \"update_ms_p99\": %.6f,\n", r.p99Ms);
+        fprintf(out, "      \"update_ms_max\": %.6f,\n", r.maxMs);
+        fprintf(out, "      \"instances_ms_mean\": %.6f,\n", r.instancesMeanMs);
+        fprintf(out, "      \"allocations_per_frame\": %.3f,\n", r.allocationsPerFrame);
+        fprintf(out, "      \"particles_per_second\": %.1f,\n", r.particlesPerSecond);
+        fprintf(out, "      \"instance_mb_per_frame\": %.3f,\n", r.instanceBytesPerFrame / 1e6);
+        fprintf(out, "      \"instance_gather_gb_per_second\": %.3f,\n", r.instanceGatherGBPerSecond);
+        fprintf(out, "      \"state_hash\": \"%016llx\"\n", (unsigned long long) r.stateHash);
+        fprintf(out, "    }%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+// one line per scenario, so a file collects results run after run
+bool appendHistory(const string &file, const Options &options, const vector<Result> &results) {
+    FILE *out = fopen(file.c_str(), "a");
+    if (!out) return false;
+    for (const Result &r : results) {
+        fprintf(out, "{\"time\": %lld, \"name\": \"%s\", \"fireworks\": %d, \"threads\": %d, \"kernel\": \"%s\", "
+                "\"config\": \"%s\", \"live_particles\": %.1f, \"live_particles_min\": %zu, \"memory_mb\": %.1f, "
+                "\"bytes_per_particle\": %.2f, \"update_ms_mean\": %.6f, \"update_ms_p99\": %.6f, "
+                "\"particles_per_second\": %.1f, "
+                "\"instance_gather_gb_per_second\": %.3f, \"state_hash\": \"%016llx\"}\n",
+                (long long) time(nullptr), r.scenario.name.c_str(), r.scenario.numFireworks, r.threads,
+                integrateKernelName(integrateKernel()), options.configFile.c_str(), r.meanLiveParticles,
+                r.minLiveParticles, r.memoryBytes / 1e6, r.bytesPerParticle, r.meanMs, r.p99Ms, r.particlesPerSecond,
+                r.instanceGatherGBPerSecond, (unsigned long long) r.stateHash);
+    }
+    return fclose(out) == 0;
+}
+
+void printUsage() {
+    fprintf(stderr, "usage: fireworks_bench [--scenario small|medium|large|stress|all] [--fireworks N] [--frames N]\n"
+            "                       [--warmup N] [--dt SECONDS] [--seed N] [--threads N]\n"
+            "                       [--particle-capacity N] [--output FILE] [--trace FILE]\n"
+            "                       [--config FILE] [--trail-detail FRACTION] [--history FILE]\n"
+            "                       [--particle-bytes N]\n");
+}
+
+bool parseArgs(int argc, char **argv, Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--help" || arg == "-h") return false;
+        if (i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", arg.c_str());
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if (arg == "--scenario") {
+            bool found = false;
+            for (const Scenario &scenario : SCENARIOS) {
+                if (string(value) == "all" || scenario.name == value) {
+                    options.scenarios.push_back(scenario);
+                    found = true;
+                }
+            }
+            if (!found) {
+                fprintf(stderr, "unknown scenario %s\n", value);
+                return false;
+            }
+        } else if (arg == "--fireworks") {
+            options.scenarios.push_back({string("custom-") + value, atoi(value)});
+        } else if (arg == "--frames") {
+            options.frames = max(1, atoi(value));
+        } else if (arg == "--warmup") {
+            options.warmup = max(0, atoi(value));
+        } else if (arg == "--dt") {
+            options.dt = atof(value);
+        } else if (arg == "--seed") {
+            options.seed = strtoul(value, nullptr, 10);
+        } else if (arg == "--threads") {
+            options.threads = atoi(value);
+        } else if (arg == "--particle-capacity") {
+            options.particleCapacity = strtoull(value, nullptr, 10);
+        } else if (arg == "--output") {
+            options.output = value;
+        } else if (arg == "--trace") {
+            options.trace = value;
+        } else if (arg == "--config") {
+            options.configFile = value;
+            if (!options.config.load(value)) return false;
+        } else if (arg == "--particle-bytes") {
+            options.particleBytes = strtoull(value, nullptr, 10);
+        } else if (arg == "--history") {
+            options.history = value;
+        } else if (arg == "--trail-detail") {
+            options.trailDetail = min(max((float) atof(value), TrailLod::MIN_DETAIL), 1.f);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+
+    // the large and stress scenarios need hundreds of MB or more, so they only run when asked for
+    if (options.scenarios.empty() && !options.configFile.empty()) {
+        options.scenarios.push_back({"config", options.config.numFireworks});
+    } else if (options.scenarios.empty()) {
+        options.scenarios.push_back(SCENARIOS[0]);
+        options.scenarios.push_back(SCENARIOS[1]);
+    }
+
+    // checked once the config is known, as the heads it can have decide the smallest layout
+    double minBytes = Simulation::minParticleBytes(options.config);
+    if (options.particleBytes > 0 && options.particleBytes < minBytes) {
+        fprintf(stderr, "particles need at least %.2f bytes\n", minBytes);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if (!parseArgs(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+
+    setTraceThreadName("main");
+    if (!options.trace.empty()) startTracing();
+
+    vector<Result> results;
+    for (const Scenario &scenario : options.scenarios) {
+        fprintf(stderr, "running %s (%d fireworks)...\n", scenario.name.c_str(), scenario.numFireworks);
+        results.push_back(Result());
+        if (!runScenario(scenario, options, results.back())) return 1;
+        if (results.back().allocationsPerFrame > 0) fprintf(stderr, "warning: %s allocated on the per-frame path\n", scenario.name.c_str());
+    }
+
+    FILE *out = stdout;
+    if (!options.output.empty()) {
+        out = fopen(options.output.c_str(), "w");
+        if (!out) {
+            fprintf(stderr, "failed to open %s\n", options.output.c_str());
+            return 1;
+        }
+    }
+    writeJson(out, options, results);
+    if (out != stdout) fclose(out);
+
+    if (!options.history.empty() && !appendHistory(options.history, options, results)) {
+        fprintf(stderr, "failed to append to %s\n", options.history.c_str());
+        return 1;
+    }
+
+    if (!options.trace.empty() && !writeTrace(options.trace)) {
+        fprintf(stderr, "failed to write %s\n", options.trace.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -1,9 +1,9 @@
 #version 330 core
 
-out vec4 color;
+in vec4 particleColor;
 
-uniform vec4 fragColor;
+out vec4 color;
 
 void main() {
-    color = fragColor;
+    color = particleColor;
 }
@@ -0,0 +1,95 @@
+#version 330 core
+
+// Advances one particle per vertex. The outputs are captured with transform
+// feedback into the other state buffer, in the same layout as the inputs.
+layout (location = 0) in vec4 posScaleLife; // xy = position, z = scale, w = life
+layout (location = 1) in vec4 color; // x = palette entry, a = alpha
+layout (location = 2) in vec4 vel; // xy = velocity, zw = launch velocity of explosion particles
+layout (location = 3) in vec4 misc; // x = life decrease rate, y = parent index, z = kind, w = mode:
+                                    // gravity for rockets, drag * 2 + fade for explosion particles, fade for trails
+
+uniform samplerBuffer particles; // the input state, four texels per particle in the order above
+uniform float dt;
+uniform uint frame;
+
+out vec4 outPosScaleLife;
+out vec4 outColor;
+out vec4 outVel;
+out vec4 outMisc;
+
+const float ROCKET = 1.0;
+const float EXPLOSION = 2.0;
+const float TRAIL = 3.0;
+
+// drag models and fade modes, as in integrate.h
+const int DRAG_NONE = 1;
+const int DRAG_QUADRATIC = 2;
+const int FADE_QUADRATIC = 1;
+
+float fadeAlpha(float life, int fade) {
+    return fade == FADE_QUADRATIC ? life * life : life;
+}
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+void main() {
+    outPosScaleLife = posScaleLife;
+    outColor = color;
+    outVel = vel;
+    outMisc = misc;
+
+    vec2 pos = posScaleLife.xy;
+    float life = posScaleLife.w;
+
+    if (misc.z == ROCKET) {
+        vec2 v = vel.xy + vec2(0.0, misc.w * dt);
+        outVel.xy = v;
+        outPosScaleLife.xy = pos + v * dt;
+    } else if (misc.z == EXPLOSION) {
+        int drag = int(misc.w) / 2;
+        float speed = drag == DRAG_NONE ? 1.0 : drag == DRAG_QUADRATIC ? life * life : life; // decrease speed of the particle over time
+        vec2 v = speed * vel.zw * dt;
+        outVel.xy = v;
+        outPosScaleLife.xy = pos + v;
+        outPosScaleLife.w = life - misc.x * dt;
+        outColor.a = fadeAlpha(life, int(misc.w) % 2);
+    } else if (misc.z == TRAIL) {
+        // follow the head's velocity from the input state; a rocket moves before its trail
+        int head = int(misc.y) * 4;
+        vec4 headPosScaleLife = texelFetch(particles, head);
+        vec2 headPos = headPosScaleLife.xy;
+        vec2 headVel = texelFetch(particles, head + 2).xy;
+        vec4 headMisc = texelFetch(particles, head + 3);
+        bool rocket = headMisc.z == ROCKET;
+        if (rocket) {
+            headVel.y += headMisc.w * dt;
+            headPos += headVel * dt;
+        }
+
+        pos += life * headVel * dt;
+        life = min(life, headPosScaleLife.w); // restrict alpha value of trailing particles
+        outColor.a = fadeAlpha(life, int(misc.w));
+        life -= misc.x * dt;
+        outVel.xy = headVel;
+
+        // relocate the particle based on the current location of its head
+        if (life <= 0.0) {
+            uint seed = hash(uint(gl_VertexID) ^ hash(frame));
+            float random = float(int(seed % 100u) - 50) / 10.0;
+            float velScale = rocket ? float(hash(seed) >> 8) / 16777215.0 * 0.25 + 0.75 : 0.1;
+            life = 1.0;
+            pos = headPos + random;
+            outVel.xy = headVel * velScale;
+        }
+
+        outPosScaleLife.xy = pos;
+        outPosScaleLife.w = life;
+    }
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec4 particleColor;
+in vec2 circlePos;
+
+out vec4 color;
+
+const float FALLOFF = 0.35; // how much dimmer the rim is than the centre
+
+void main() {
+    float r = length(circlePos);
+    float edge = fwidth(r); // one pixel in circle units
+    float coverage = 1.0 - smoothstep(1.0 - edge, 1.0 + edge, r);
+    if (coverage <= 0.0) discard;
+
+    color = vec4(particleColor.rgb, particleColor.a * coverage * (1.0 - FALLOFF * r * r));
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// Expands each particle into a screen-aligned quad around its circle; the
+// circle itself is shaped in sprite_fragment.glsl
+layout (location = 0) in vec3 pos; // quad corner, (+-1, +-1)
+layout (location = 1) in vec3 instancePosScale; // xy = particle position, z = scale (radius)
+layout (location = 2) in float instanceAlpha;
+layout (location = 3) in vec3 instancePalette; // palette entry as base-256 digits, least significant first
+
+uniform mat4 mvp;
+uniform samplerBuffer palette; // RGBA color of each firework
+
+out vec4 particleColor;
+out vec2 circlePos; // position relative to the circle, 1 at its edge
+
+const float EDGE_MARGIN = 1.0; // room for the antialiased edge; world units are pixels
+
+void main() {
+    float radius = instancePosScale.z;
+    float extent = radius > 0.0 ? radius + EDGE_MARGIN : 0.0; // dead particles collapse to a point
+
+    int entry = int(dot(instancePalette, vec3(1.0, 256.0, 65536.0)) + 0.5);
+    particleColor = vec4(texelFetch(palette, entry).rgb, instanceAlpha);
+    circlePos = radius > 0.0 ? pos.xy * extent / radius : vec2(2.0);
+    gl_Position = mvp * vec4(pos.xy * extent + instancePosScale.xy, pos.z, 1.0f);
+}
@@ -1,9 +1,17 @@
 #version 330 core
 
 layout (location = 0) in vec3 pos;
+layout (location = 1) in vec3 instancePosScale; // xy = particle position, z = scale
+layout (location = 2) in float instanceAlpha;
+layout (location = 3) in vec3 instancePalette; // palette entry as base-256 digits, least significant first
 
 uniform mat4 mvp;
+uniform samplerBuffer palette; // RGBA color of each firework
+
+out vec4 particleColor;
 
 void main() {
-    gl_Position = mvp * vec4(pos, 1.0f);
+    int entry = int(dot(instancePalette, vec3(1.0, 256.0, 65536.0)) + 0.5);
+    particleColor = vec4(texelFetch(palette, entry).rgb, instanceAlpha);
+    gl_Position = mvp * vec4(pos.xy * instancePosScale.z + instancePosScale.xy, pos.z, 1.0f);
 }
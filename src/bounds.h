@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cmath>
+
+// Axis-aligned world-space rectangle, such as the area a camera shows. The
+// default rectangle is unbounded.
+struct Bounds {
+    float left = -INFINITY, bottom = -INFINITY;
+    float right = INFINITY, top = INFINITY;
+
+    // whether a circle at (x, y) overlaps the rectangle
+    bool overlaps(float x, float y, float radius) const {
+        return x + radius >= left && x - radius <= right && y + radius >= bottom && y - radius <= top;
+    }
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+// size of the world the fireworks launch into; firework tunables are in firework_config.h
+const int WORLD_WIDTH = 800;
+const int WORLD_HEIGHT = 600;
+
+// fireworks in the stress scenario, which keeps over a million particles live
+// with the default types once their launches are spread over a firework's life
+const int STRESS_FIREWORKS = 5000;
+const float STRESS_STAGGER_SECONDS = 4.f;
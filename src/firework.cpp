@@ -0,0 +1,204 @@
+#include "firework.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "constants.h"
+#include "integrate.h"
+#include "trace.h"
+
+using namespace std;
+
+const float TRAIL_RESPAWN_SPREAD = 5.f; // furthest a trail particle respawns from its head on each axis
+
+// edges of bounds that a circle lies entirely beyond, one bit each
+enum { PAST_LEFT = 1, PAST_RIGHT = 2, PAST_BOTTOM = 4, PAST_TOP = 8 };
+
+static int edgesPassed(const Bounds &bounds, float x, float y, float radius) {
+    return (x + radius < bounds.left ? PAST_LEFT : 0) | (x - radius > bounds.right ? PAST_RIGHT : 0)
+        | (y + radius < bounds.bottom ? PAST_BOTTOM : 0) | (y - radius > bounds.top ? PAST_TOP : 0);
+}
+
+void Firework::randomiseColor() {
+    // randomise rgb colors in range [0.25, 1.0]
+    color.r = rng.nextFloat() * 0.75f + 0.25f;
+    color.g = rng.nextFloat() * 0.75f + 0.25f;
+    color.b = rng.nextFloat() * 0.75f + 0.25f;
+}
+
+// Destroy exisiting particles and relaunch the rocket from the ground
+void Firework::reset(ParticleSystem &ps, const FireworkType &params) {
+    launched = true;
+    exploded = false;
+    numParticles = randomRange(rng, params.minParticles, params.maxParticles);
+    numHeads = 1;
+    numTrails = params.numTrails;
+
+    randomiseColor();
+
+    uint32_t rocket = first;
+    uint32_t head = ps.heads(first);
+    ps.posX[rocket] = (float) (rng.nextInt() % WORLD_WIDTH);
+    ps.posY[rocket] = 0.f;
+    ps.settle(rocket);
+    ps.velX[head] = randomRange(rng, params.minLaunchVelX, params.maxLaunchVelX);
+    ps.velY[head] = randomRange(rng, params.minLaunchVelY, params.maxLaunchVelY);
+    ps.origVelX[head] = ps.velX[head];
+    ps.origVelY[head] = ps.velY[head];
+    ps.alpha[rocket] = 255;
+    ps.setLife(rocket, 1.0f); // the rocket never fades, so its trail is never dimmed
+    ps.scale[head] = randomRange(rng, params.minScale, params.maxScale);
+    ps.decayRate[rocket] = 0.f;
+    headScale = ps.scale[head];
+
+    spawnTrailParticles(ps, params, 0, numTrails);
+}
+
+// fill rings [firstRing, endRing) with a trail particle for every head, starting at the head's position
+void Firework::spawnTrailParticles(ParticleSystem &ps, const FireworkType &params, int firstRing, int endRing) {
+    uint32_t i = first + (uint32_t) numHeads * (1 + firstRing);
+    for (int ring = firstRing; ring < endRing; ++ring) {
+        for (uint32_t head = first; head < first + numHeads; ++head, ++i) {
+            ps.posX[i] = ps.posX[head];
+            ps.posY[i] = ps.posY[head];
+            ps.settle(i);
+            ps.alpha[i] = 255;
+            ps.setLife(i, 1.0f);
+            ps.decayRate[i] = rng.nextFloat() * (params.maxTrailDecayRate - params.minTrailDecayRate) + params.minTrailDecayRate;
+        }
+    }
+}
+
+// relocate a trailing particle based on the current location of the particle it follows
+void Firework::respawnTrailParticle(uint32_t i, ParticleSystem &ps) {
+    uint32_t head = first + (i - first) % numHeads; // same place in its ring as its head among the heads
+    float random = ((rng.nextInt() % 100) - 50) / 10.0f;
+    ps.setLife(i, 1.0f);
+    ps.posX[i] = ps.posX[head] + random;
+    ps.posY[i] = ps.posY[head] + random;
+    ps.settle(i);
+}
+
+void Firework::updateTrailParticles(float dt, ParticleSystem &ps, FadeMode fade) {
+    uint32_t trails = first + numHeads;
+    uint32_t end = first + numLive();
+
+    integrateTrailParticles(ps, first, numHeads, trails, end, dt, fade);
+
+    for (uint32_t i = trails; i < end; ++i) {
+        if (ps.lifeAt(i) <= 0) respawnTrailParticle(i, ps);
+    }
+}
+
+// replace the rocket and its trail with explosion particles
+void Firework::explode(ParticleSystem &ps, const FireworkType &params) {
+    TRACE_SCOPE("explode");
+    exploded = true;
+    float x = ps.posX[first];
+    float y = ps.posY[first];
+    float theta = M_PI * 2 / (float) params.numDirections;
+
+    numHeads = numParticles;
+    headScale = 0;
+    for (uint32_t i = first, head = ps.heads(first); i < first + numHeads; ++i, ++head) {
+        float randTheta = rng.nextInt() % params.numDirections * theta; // randomise the direction of the particle
+        float magnitude = randomRange(rng, params.minSpeed, params.maxSpeed); // randomise the magnitude of the particle's speed
+        ps.posX[i] = x;
+        ps.posY[i] = y;
+        ps.settle(i);
+        ps.velX[head] = ps.origVelX[head] = cos(randTheta) * magnitude;
+        ps.velY[head] = ps.origVelY[head] = sin(randTheta) * magnitude;
+        ps.alpha[i] = 255;
+        ps.setLife(i, 1.0f);
+        ps.scale[head] = randomRange(rng, params.minScale, params.maxScale);
+        ps.decayRate[i] = params.explosionDecayRate;
+        headScale = max(headScale, ps.scale[head]);
+    }
+
+    spawnTrailParticles(ps, params, 0, numTrails);
+}
+
+void Firework::setTrailRings(int rings, ParticleSystem &ps, const FireworkType &params) {
+    rings = min(rings, params.numTrails);
+    if (rings > numTrails) spawnTrailParticles(ps, params, numTrails, rings);
+    numTrails = rings;
+}
+
+// Explosion particles travel in a straight line, so one that is past an edge
+// of bounds and heading away from it, along with its whole trail, can never
+// come back into view. Drop those heads and their trails by compacting every
+// segment of the block, keeping the ring layout.
+void Firework::retireParticles(ParticleSystem &ps, const Bounds &bounds) {
+    uint32_t heads = ps.heads(first);
+    keptHeads.clear();
+    for (int h = 0; h < numHeads; ++h) {
+        uint32_t head = first + h;
+        int away = (ps.origVelX[heads + h] <= 0 ? PAST_LEFT : PAST_RIGHT) | (ps.origVelY[heads + h] <= 0 ? PAST_BOTTOM : PAST_TOP);
+        // trail particles respawn around the head, and the previous position is still drawn when interpolating
+        float reach = ps.scale[heads + h] + TRAIL_RESPAWN_SPREAD;
+        int edges = away & edgesPassed(bounds, ps.posX[head], ps.posY[head], reach);
+        if (ps.interpolated) edges &= edgesPassed(bounds, ps.prevPosX[head], ps.prevPosY[head], reach);
+        for (uint32_t i = head + numHeads; edges && i < first + numLive(); i += numHeads) {
+            edges &= edgesPassed(bounds, ps.posX[i], ps.posY[i], TRAIL_SCALE);
+            if (ps.interpolated) edges &= edgesPassed(bounds, ps.prevPosX[i], ps.prevPosY[i], TRAIL_SCALE);
+        }
+        if (!edges) keptHeads.push_back(h);
+    }
+    if ((int) keptHeads.size() == numHeads) return;
+
+    // every particle moves to a lower or equal index, so compacting in order never overwrites unread ones
+    uint32_t newHeads = keptHeads.size();
+    for (uint32_t k = 0; k < newHeads; ++k) {
+        uint32_t src = heads + keptHeads[k];
+        uint32_t dst = heads + k;
+        ps.velX[dst] = ps.velX[src];
+        ps.velY[dst] = ps.velY[src];
+        ps.origVelX[dst] = ps.origVelX[src];
+        ps.origVelY[dst] = ps.origVelY[src];
+        ps.scale[dst] = ps.scale[src];
+    }
+    for (int segment = 0; segment <= numTrails; ++segment) {
+        uint32_t from = first + (uint32_t) segment * numHeads;
+        uint32_t to = first + segment * newHeads;
+        for (uint32_t k = 0; k < newHeads; ++k) ps.move(to + k, from + keptHeads[k]);
+    }
+    numHeads = newHeads;
+}
+
+void Firework::update(float dt, ParticleSystem &ps, const FireworkType &params, const Bounds &bounds) {
+    if (!launched) return;
+
+    if (numTrails > 0) step<true>(dt, ps, params, bounds);
+    else step<false>(dt, ps, params, bounds);
+}
+
+template <bool hasTrails>
+void Firework::step(float dt, ParticleSystem &ps, const FireworkType &params, const Bounds &bounds) {
+    // remember where every particle was for interpolating between steps
+    if (ps.interpolated) {
+        copy(&ps.posX[first], &ps.posX[first] + numLive(), &ps.prevPosX[first]);
+        copy(&ps.posY[first], &ps.posY[first] + numLive(), &ps.prevPosY[first]);
+    }
+
+    if (exploded) {
+        // trails follow their explosion particle's velocity from the previous step
+        if constexpr (hasTrails) updateTrailParticles(dt, ps, params.fade);
+
+        integrateExplosionParticles(ps, first, numHeads, dt, params.drag, params.fade);
+
+        // all explosion particles share the same life, so they burn out together
+        if (ps.lifeAt(first) <= 0) numHeads = 0;
+        else retireParticles(ps, bounds);
+        if (numHeads == 0) launched = false;
+    } else { // update the rocket
+        uint32_t rocket = first;
+        uint32_t head = ps.heads(first);
+        ps.velY[head] += params.gravity * dt;
+        ps.posX[rocket] += ps.velX[head] * dt;
+        ps.posY[rocket] += ps.velY[head] * dt;
+
+        if constexpr (hasTrails) updateTrailParticles(dt, ps, params.fade);
+
+        if (ps.velY[head] < 0) explode(ps, params);
+    }
+}
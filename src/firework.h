@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "bounds.h"
+#include "firework_config.h"
+#include "particle_pool.h"
+#include "particle_system.h"
+#include "random.h"
+
+// Firework that maintains the "rocket" and all particles of the firework.
+//
+// The particles live in a block of the ParticleSystem starting at `first`,
+// taken from the ParticlePool when the firework launches and handed back once
+// it has burnt out.
+// The block begins with numHeads head particles (the rocket before the
+// explosion, one per explosion particle after it), followed by numTrails rings
+// of trail particles. Each ring holds one trail particle per head, in head
+// order, so trail particle i of a ring follows head i. The heads' velocities
+// and scales are in the ParticleSystem's head arrays from ps.heads(first).
+struct Firework {
+    uint32_t first = ParticlePool::NO_BLOCK;
+    uint32_t type = 0; // index into the FireworkConfig type table
+    int numHeads = 0;
+    int numTrails = 0;
+    Color color;
+    bool launched = false; // in flight; once it burns out the block is still held until released
+    bool exploded = false;
+    int numParticles; // explosion particles created when the rocket bursts
+    float headScale = 0; // largest scale among the heads
+    Random rng; // every random choice the firework makes comes from here
+    std::vector<uint32_t> keptHeads; // scratch for retiring explosion particles, reused between steps
+
+    // number of particles currently in use at the start of the block
+    uint32_t numLive() const { return (uint32_t) numHeads * (1 + numTrails); }
+
+    // launch a new rocket from the block at `first`; params is the entry of
+    // the type table for `type`, and every later call passes the same one
+    void reset(ParticleSystem &ps, const FireworkType &params);
+    // explosion particles that leave bounds for good are retired early
+    void update(float dt, ParticleSystem &ps, const FireworkType &params, const Bounds &bounds = Bounds());
+
+    // replace the rocket, wherever it is in the block, with explosion particles
+    void explode(ParticleSystem &ps, const FireworkType &params);
+
+    // keep only the first `rings` trail rings (at most params.numTrails),
+    // spawning any that are added at their heads
+    void setTrailRings(int rings, ParticleSystem &ps, const FireworkType &params);
+
+private:
+    void randomiseColor();
+    void spawnTrailParticles(ParticleSystem &ps, const FireworkType &params, int firstRing, int endRing);
+    void respawnTrailParticle(uint32_t i, ParticleSystem &ps);
+    void updateTrailParticles(float dt, ParticleSystem &ps, FadeMode fade);
+    void retireParticles(ParticleSystem &ps, const Bounds &bounds);
+
+    // update() specialised on whether the firework has trails, picked once per call
+    template <bool hasTrails>
+    void step(float dt, ParticleSystem &ps, const FireworkType &params, const Bounds &bounds);
+};
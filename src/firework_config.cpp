@@ -0,0 +1,178 @@
+#include "firework_config.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+string trim(const string &s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+// read one or two values, failing if anything is left over
+template <typename T>
+bool parseValues(const string &text, T *a, T *b = nullptr) {
+    istringstream in(text);
+    if (!(in >> *a)) return false;
+    if (b && !(in >> *b)) return false;
+    string rest;
+    return !(in >> rest);
+}
+
+// a range given as "min max", or a single value for both
+template <typename T>
+bool parseRange(const string &text, T &min, T &max) {
+    if (parseValues(text, &min, &max)) return true;
+    if (!parseValues(text, &min)) return false;
+    max = min;
+    return true;
+}
+
+// index of value in names, or -1
+int parseName(const string &value, const char *const *names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (value == names[i]) return i;
+    }
+    return -1;
+}
+
+const char *const DRAG_NAMES[NUM_DRAG_MODELS] = {"life", "none", "quadratic"};
+const char *const FADE_NAMES[NUM_FADE_MODES] = {"linear", "quadratic"};
+
+// set one key of a type; returns an error message, empty on success
+string setTypeKey(FireworkType &type, const string &key, const string &value) {
+    bool ok;
+    if (key == "weight") ok = parseValues(value, &type.weight) && type.weight >= 0;
+    else if (key == "gravity") ok = parseValues(value, &type.gravity) && type.gravity < 0; // rockets must fall to explode
+    else if (key == "particles") ok = parseRange(value, type.minParticles, type.maxParticles) && type.minParticles > 0;
+    else if (key == "trails") ok = parseValues(value, &type.numTrails) && type.numTrails >= 0;
+    else if (key == "scale") ok = parseRange(value, type.minScale, type.maxScale) && type.minScale > 0;
+    else if (key == "launch_velocity_x") ok = parseRange(value, type.minLaunchVelX, type.maxLaunchVelX);
+    else if (key == "launch_velocity_y") ok = parseRange(value, type.minLaunchVelY, type.maxLaunchVelY) && type.minLaunchVelY > 0;
+    else if (key == "explosion_speed") ok = parseRange(value, type.minSpeed, type.maxSpeed);
+    else if (key == "explosion_directions") ok = parseValues(value, &type.numDirections) && type.numDirections > 0;
+    else if (key == "explosion_decay") ok = parseValues(value, &type.explosionDecayRate) && type.explosionDecayRate > 0;
+    else if (key == "trail_decay") ok = parseRange(value, type.minTrailDecayRate, type.maxTrailDecayRate) && type.minTrailDecayRate > 0;
+    else if (key == "drag") {
+        int drag = parseName(value, DRAG_NAMES, NUM_DRAG_MODELS);
+        if ((ok = drag >= 0)) type.drag = (DragModel) drag;
+    } else if (key == "fade") {
+        int fade = parseName(value, FADE_NAMES, NUM_FADE_MODES);
+        if ((ok = fade >= 0)) type.fade = (FadeMode) fade;
+    }
+    else return "unknown key " + key;
+
+    if (!ok) return "bad value for " + key + ": " + value;
+    return "";
+}
+
+}
+
+bool FireworkConfig::load(const string &file) {
+    ifstream in(file);
+    if (!in) {
+        cout << "Failed to open " << file << endl;
+        return false;
+    }
+
+    // nothing changes unless the whole file loads
+    int loadedNumFireworks = numFireworks;
+    vector<FireworkType> loadedTypes;
+    vector<string> loadedNames;
+    bool inShow = true;
+    string line;
+    for (int lineNumber = 1; getline(in, line); ++lineNumber) {
+        size_t comment = line.find_first_of(";#");
+        line = trim(line.substr(0, comment));
+        if (line.empty()) continue;
+
+        string error;
+        if (line.front() == '[') {
+            string name = trim(line.substr(1, line.find(']') - 1));
+            if (line.back() != ']' || name.empty()) {
+                error = "bad section header";
+            } else {
+                inShow = name == "show";
+                if (!inShow) {
+                    loadedTypes.push_back(FireworkType());
+                    loadedNames.push_back(name);
+                }
+            }
+        } else {
+            size_t equals = line.find('=');
+            string key = trim(line.substr(0, equals));
+            string value = equals == string::npos ? "" : trim(line.substr(equals + 1));
+            if (equals == string::npos || key.empty()) {
+                error = "expected key = value";
+            } else if (inShow) {
+                if (key != "fireworks") error = "unknown key " + key;
+                else if (!parseValues(value, &loadedNumFireworks) || loadedNumFireworks < 0) error = "bad value for fireworks: " + value;
+            } else {
+                error = setTypeKey(loadedTypes.back(), key, value);
+            }
+        }
+
+        if (!error.empty()) {
+            cout << file << ":" << lineNumber << ": " << error << endl;
+            return false;
+        }
+    }
+
+    // a file without types keeps the default one
+    FireworkConfig loaded = *this;
+    loaded.numFireworks = loadedNumFireworks;
+    if (!loadedTypes.empty()) {
+        double totalWeight = 0;
+        for (auto &type : loadedTypes) totalWeight += type.weight;
+        if (totalWeight <= 0) {
+            cout << file << ": every firework type has zero weight" << endl;
+            return false;
+        }
+        loaded.types = loadedTypes;
+        loaded.names = loadedNames;
+    }
+
+    uint64_t numParticles = loaded.numParticles(loaded.numFireworks);
+    if (numParticles > MAX_PARTICLES) {
+        cout << file << ": " << numParticles << " particles is more than the limit of " << MAX_PARTICLES << endl;
+        return false;
+    }
+    *this = loaded;
+    return true;
+}
+
+uint64_t FireworkConfig::blockSize() const {
+    uint64_t size = 0;
+    for (auto &type : types) size = max(size, type.blockSize());
+    return size;
+}
+
+uint32_t FireworkConfig::maxHeads() const {
+    uint32_t heads = 1;
+    for (auto &type : types) heads = max(heads, (uint32_t) max(type.minParticles, type.maxParticles));
+    return heads;
+}
+
+uint32_t FireworkConfig::pickType(Random &rng) const {
+    if (types.size() == 1) return 0;
+
+    float totalWeight = 0;
+    for (auto &type : types) totalWeight += type.weight;
+
+    float pick = rng.nextFloat() * totalWeight;
+    for (uint32_t i = 0; i < types.size(); ++i) {
+        if (pick < types[i].weight) return i;
+        pick -= types[i].weight;
+    }
+    // rounding can leave pick just past the last weight
+    for (uint32_t i = types.size(); i-- > 0;) {
+        if (types[i].weight > 0) return i;
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "integrate.h"
+#include "random.h"
+
+// Tunables of one kind of firework. Integer ranges are [min, max), or just
+// min when they are equal. The defaults are the original show.
+struct FireworkType {
+    float gravity = -200.f; // vertical acceleration applied to rockets, negative so they fall and explode
+    int minParticles = 30, maxParticles = 50; // explosion particles
+    int numTrails = 15; // trail particles behind every rocket and explosion particle
+    int minScale = 1, maxScale = 3; // size of rockets and explosion particles
+    int minLaunchVelX = -20, maxLaunchVelX = 20;
+    int minLaunchVelY = 300, maxLaunchVelY = 500;
+    int minSpeed = 20, maxSpeed = 200; // initial speed of explosion particles
+    int numDirections = 50; // explosion particles leave along one of this many angles
+    float explosionDecayRate = 0.5f; // life lost per second by explosion particles
+    float minTrailDecayRate = 3, maxTrailDecayRate = 6; // trail respawns per second
+    DragModel drag = DRAG_LIFE; // how explosion particles slow down
+    FadeMode fade = FADE_LINEAR; // how explosion and trail particles fade with life
+    float weight = 1; // how often this type launches relative to the others
+
+    // most particles a firework of this type holds at once, in 64 bits so a
+    // large config cannot wrap it
+    uint64_t blockSize() const { return (uint64_t) std::max(minParticles, maxParticles) * (1 + (uint64_t) numTrails); }
+};
+
+// The show: how many fireworks fly at once and the types they are drawn from.
+// Types live in one dense table indexed by type id; their names are kept apart
+// so the table stays small.
+struct FireworkConfig {
+    // particles are indexed with 32 bits, so all the blocks together must stay within this
+    static const uint64_t MAX_PARTICLES = UINT32_MAX;
+
+    int numFireworks = 10;
+    std::vector<FireworkType> types = {FireworkType()};
+    std::vector<std::string> names = {"default"};
+
+    // read an INI file: global keys before any section or under [show], then
+    // one [name] section per firework type starting from the defaults above.
+    // Reports the first error with its line and returns false.
+    bool load(const std::string &file);
+
+    // the largest blockSize() of any type, which every firework block must hold
+    uint64_t blockSize() const;
+    // particles taken by numBlocks blocks, or by one block if there are none
+    uint64_t numParticles(uint64_t numBlocks) const { return std::max<uint64_t>(numBlocks, 1) * blockSize(); }
+    // the most explosion particles of any type, which is the most heads a block holds
+    uint32_t maxHeads() const;
+
+    // weighted choice of the type of the next launch
+    uint32_t pickType(Random &rng) const;
+};
+
+// random integer in [min, max), or min when the range is empty
+inline int randomRange(Random &rng, int min, int max) {
+    return max > min ? rng.nextInt() % (max - min) + min : min;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <algorithm>
+
+// Turns variable frame times into a whole number of fixed simulation steps.
+// Time that is left over carries into the next frame and is exposed as an
+// interpolation factor for rendering between the last two steps. A frame that
+// would need more than maxSteps steps runs maxSteps and drops the rest of the
+// backlog, so a hitch slows the show down instead of stalling it.
+struct FixedTimestep {
+    double step;
+    int maxSteps;
+    double accumulator = 0;
+
+    explicit FixedTimestep(double stepsPerSecond = 60.0, int maxSteps = 5)
+        : step(1.0 / stepsPerSecond), maxSteps(std::max(maxSteps, 1)) {}
+
+    // add a frame's elapsed time in seconds and return how many steps to run
+    int advance(double frameTime) {
+        accumulator += frameTime;
+        int steps = (int) (accumulator / step);
+        if (steps > maxSteps) {
+            steps = maxSteps;
+            accumulator = step * maxSteps;
+        }
+        accumulator -= steps * step;
+        return steps;
+    }
+
+    float stepSeconds() const { return (float) step; }
+
+    // how far between the previous and the latest step the display time is, in [0, 1)
+    float interpolation() const { return (float) (accumulator / step); }
+};
@@ -0,0 +1,228 @@
+#include "frame_exporter.h"
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <cctype>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+
+unsigned char clampByte(int x) {
+    return (unsigned char) (x < 0 ? 0 : x > 255 ? 255 : x);
+}
+
+// whether pattern is safe to hand to snprintf with the frame number: one
+// %d or %i with optional flags and width, and no other conversion but %%
+bool isFramePattern(const string &pattern) {
+    int numConversions = 0;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (pattern[i] != '%') continue;
+        if (++i < pattern.size() && pattern[i] == '%') continue;
+        while (i < pattern.size() && strchr("-+ 0#", pattern[i])) ++i;
+        while (i < pattern.size() && isdigit((unsigned char) pattern[i])) ++i;
+        if (i == pattern.size() || (pattern[i] != 'd' && pattern[i] != 'i')) return false;
+        ++numConversions;
+    }
+    return numConversions == 1;
+}
+
+}
+
+bool FrameExporter::open(const string &target, ExportFormat format, int width, int height, int framesPerSecond) {
+    this->target = target;
+    this->format = format;
+    this->width = width;
+    this->height = height;
+    this->framesPerSecond = framesPerSecond;
+    numCaptured = framesWritten = encoderWaits = 0;
+    failed = stopping = false;
+
+    if (format == EXPORT_PNG) {
+        if (this->target.find('%') == string::npos) this->target += "%05d.png";
+        if (!isFramePattern(this->target)) {
+            cout << "Export pattern " << target << " needs exactly one %d, such as show_%05d.png" << endl;
+            return false;
+        }
+    } else {
+        pipe = !target.empty() && target[0] == '|';
+        // a command that exits early would otherwise kill the viewer on the
+        // next write, before --profile and --trace output is saved; ignored,
+        // the write fails with EPIPE instead
+        if (pipe) signal(SIGPIPE, SIG_IGN);
+        out = pipe ? popen(target.c_str() + 1, "w") : fopen(target.c_str(), "wb");
+        if (!out) {
+            cout << "Failed to open " << target << " for export" << endl;
+            return false;
+        }
+        if (format == EXPORT_Y4M) fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", width, height, framesPerSecond);
+    }
+
+    size_t frameSize = (size_t) width * height * 4;
+    glGenBuffers(NUM_PBOS, pbos);
+    for (int i = 0; i < NUM_PBOS; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    frames.assign(NUM_FRAME_BUFFERS, vector<unsigned char>(frameSize));
+    freeFrames.clear();
+    readyFrames.clear();
+    for (int i = 0; i < NUM_FRAME_BUFFERS; ++i) freeFrames.push_back(i);
+    encoder = thread(&FrameExporter::encodeLoop, this);
+    return true;
+}
+
+void FrameExporter::capture() {
+    if (failed) return; // every frame would be thrown away
+    TRACE_SCOPE("export capture");
+    int slot = numCaptured % NUM_PBOS;
+    if (fences[slot]) collect(slot);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++numCaptured;
+}
+
+// copy a finished readback out of its PBO and queue it for the encoder
+void FrameExporter::collect(int slot) {
+    glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+
+    int frame;
+    {
+        unique_lock<mutex> lock(queueMutex);
+        if (freeFrames.empty()) ++encoderWaits;
+        frameFree.wait(lock, [this] { return !freeFrames.empty(); });
+        frame = freeFrames.front();
+        freeFrames.pop_front();
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+    const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frames[frame].size(), GL_MAP_READ_BIT);
+    if (pixels) {
+        memcpy(frames[frame].data(), pixels, frames[frame].size());
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (pixels) readyFrames.push_back(frame);
+        else freeFrames.push_back(frame);
+    }
+    frameReady.notify_one();
+}
+
+void FrameExporter::close() {
+    if (!isOpen()) return;
+
+    // the oldest outstanding readbacks come first
+    for (size_t i = 0; i < NUM_PBOS; ++i) {
+        int slot = (numCaptured + i) % NUM_PBOS;
+        if (fences[slot]) collect(slot);
+    }
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    frameReady.notify_one();
+    encoder.join();
+
+    glDeleteBuffers(NUM_PBOS, pbos);
+    frames.clear();
+    if (out) {
+        if (pipe) pclose(out);
+        else fclose(out);
+        out = nullptr;
+    }
+    cout << "Exported " << framesWritten << " frames";
+    if (encoderWaits) cout << " (capture waited on the encoder " << encoderWaits << " times)";
+    cout << endl;
+}
+
+void FrameExporter::encodeLoop() {
+    setTraceThreadName("encoder");
+    vector<unsigned char> scratch;
+    while (true) {
+        int frame;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            frameReady.wait(lock, [this] { return stopping || !readyFrames.empty(); });
+            if (readyFrames.empty()) return;
+            frame = readyFrames.front();
+            readyFrames.pop_front();
+        }
+
+        if (!failed) {
+            TRACE_SCOPE("export encode");
+            if (write(frames[frame], scratch)) ++framesWritten;
+            else failed = true;
+        }
+
+        {
+            lock_guard<mutex> lock(queueMutex);
+            freeFrames.push_back(frame);
+        }
+        frameFree.notify_one();
+    }
+}
+
+// pixels are RGBA rows from the bottom of the image up, as GL reads them
+bool FrameExporter::write(const vector<unsigned char> &pixels, vector<unsigned char> &scratch) {
+    size_t rowSize = (size_t) width * 4;
+
+    if (format == EXPORT_PNG) {
+        scratch.resize(pixels.size());
+        for (int y = 0; y < height; ++y) memcpy(&scratch[y * rowSize], &pixels[(height - 1 - y) * rowSize], rowSize);
+
+        char file[4096];
+        snprintf(file, sizeof(file), target.c_str(), (int) framesWritten);
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(scratch.data(), width, height, 32, (int) rowSize, SDL_PIXELFORMAT_RGBA32);
+        bool saved = surface && IMG_SavePNG(surface, file) == 0;
+        if (surface) SDL_FreeSurface(surface);
+        if (!saved) cout << "Failed to write " << file << ", stopping the export" << endl;
+        return saved;
+    }
+
+    size_t planeSize = (size_t) width * height;
+    if (format == EXPORT_RGB) {
+        scratch.resize(planeSize * 3);
+        unsigned char *rgb = scratch.data();
+        for (int y = height - 1; y >= 0; --y) {
+            const unsigned char *row = &pixels[y * rowSize];
+            for (int x = 0; x < width; ++x, rgb += 3) memcpy(rgb, row + x * 4, 3);
+        }
+    } else {
+        // full resolution BT.601 studio-range Y'CbCr, one plane after another
+        scratch.resize(planeSize * 3);
+        unsigned char *yPlane = scratch.data(), *cbPlane = yPlane + planeSize, *crPlane = cbPlane + planeSize;
+        size_t i = 0;
+        for (int y = height - 1; y >= 0; --y) {
+            const unsigned char *row = &pixels[y * rowSize];
+            for (int x = 0; x < width; ++x, ++i) {
+                int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+                yPlane[i] = clampByte(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                cbPlane[i] = clampByte(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+                crPlane[i] = clampByte(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+            }
+        }
+        fputs("FRAME\n", out);
+    }
+
+    if (fwrite(scratch.data(), 1, scratch.size(), out) != scratch.size()) {
+        cout << "Failed to write to " << target << ", stopping the export" << endl;
+        return false;
+    }
+    return true;
+}
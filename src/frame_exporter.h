@@ -0,0 +1,68 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ExportFormat { EXPORT_PNG, EXPORT_Y4M, EXPORT_RGB };
+
+// Records rendered frames without stalling the GL pipeline. capture() starts
+// an asynchronous glReadPixels into one of a ring of pixel buffer objects and
+// collects the frame read NUM_PBOS captures earlier, which has long finished.
+// Collected frames go to a background thread that encodes and writes them, so
+// neither readback nor disk I/O runs on the render thread. If the encoder falls
+// NUM_FRAME_BUFFERS frames behind, capture() waits for it rather than drop frames.
+// Once a write fails, such as when the command behind a pipe exits, nothing
+// more is read back or written and hasFailed() turns true.
+struct FrameExporter {
+    static const int NUM_PBOS = 3;
+    static const int NUM_FRAME_BUFFERS = 8;
+
+    // target is a printf pattern for PNG sequences ("show_%05d.png", with
+    // exactly one integer conversion and %% for a literal %; a plain prefix
+    // gets "%05d.png" appended), a file for Y4M and RGB, or
+    // "|command" to pipe Y4M or RGB into a command such as ffmpeg
+    bool open(const std::string &target, ExportFormat format, int width, int height, int framesPerSecond);
+    bool isOpen() const { return encoder.joinable(); }
+
+    // read back the current framebuffer; needs a current GL context
+    void capture();
+    bool hasFailed() const { return failed; }
+    // write every captured frame and stop the encoder
+    void close();
+
+    size_t numFramesWritten() const { return framesWritten; }
+
+private:
+    std::string target;
+    ExportFormat format = EXPORT_PNG;
+    int width = 0, height = 0, framesPerSecond = 60;
+    FILE *out = nullptr;
+    bool pipe = false;
+
+    GLuint pbos[NUM_PBOS] = {0};
+    GLsync fences[NUM_PBOS] = {0};
+    size_t numCaptured = 0;
+
+    // frame buffers cycle from freeFrames to readyFrames and back
+    std::vector<std::vector<unsigned char>> frames;
+    std::deque<int> freeFrames, readyFrames;
+    std::mutex queueMutex;
+    std::condition_variable frameFree, frameReady;
+    bool stopping = false;
+    std::thread encoder;
+
+    size_t framesWritten = 0; // written by the encoder thread, read after close()
+    size_t encoderWaits = 0; // captures that had to wait for a free frame buffer
+    std::atomic<bool> failed{false}; // set by the encoder thread
+
+    void collect(int slot);
+    void encodeLoop();
+    bool write(const std::vector<unsigned char> &pixels, std::vector<unsigned char> &scratch);
+};
@@ -0,0 +1,175 @@
+#include "gpu_simulation.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+
+#include "trace.h"
+
+using namespace std;
+
+bool GpuSimulation::init(const FireworkConfig &config, uint64_t seed) {
+    this->config = config;
+    int numFireworks = config.numFireworks;
+    uint64_t numParticles = config.numParticles(numFireworks); // the staging block is needed even without fireworks
+
+    GLint maxTexels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    uint64_t limit = min<uint64_t>(maxTexels / 4, MAX_GPU_PARTICLES);
+    if (numParticles > limit) {
+        cout << "Too many particles for the GPU simulation (" << numParticles << ", limit " << limit << ")" << endl;
+        return false;
+    }
+    blockSize = (uint32_t) config.blockSize();
+    capacity = (uint32_t) numFireworks * blockSize;
+
+    if (!program.loadTransformFeedback("./shaders/simulate.glsl", {"outPosScaleLife", "outColor", "outVel", "outMisc"})) return false;
+    particlesLocation = program.uniform("particles");
+    dtLocation = program.uniform("dt");
+    frameLocation = program.uniform("frame");
+
+    // every particle starts dead: zero scale, alpha and kind
+    vector<GpuParticle> dead(capacity, GpuParticle());
+    glGenBuffers(2, stateBuffers);
+    glGenTextures(2, stateTextures);
+    glGenVertexArrays(2, updateVAOs);
+    for (int i = 0; i < 2; ++i) {
+        glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GpuParticle), dead.data(), GL_DYNAMIC_COPY);
+
+        glBindTexture(GL_TEXTURE_BUFFER, stateTextures[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, stateBuffers[i]);
+
+        glBindVertexArray(updateVAOs[i]);
+        for (GLuint attrib = 0; attrib < 4; ++attrib) {
+            glEnableVertexAttribArray(attrib);
+            glVertexAttribPointer(attrib, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void *) (attrib * 4 * sizeof(float)));
+        }
+    }
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    staging.interpolated = false; // the GPU state has no previous positions
+    staging.headsPerBlock = config.maxHeads();
+    staging.resize(1, blockSize);
+    uploadBlock.resize(blockSize);
+    fireworks.assign(numFireworks, Firework());
+    lifecycles.assign(numFireworks, Lifecycle());
+    frame = (uint32_t) seed; // the trail respawn hash in the shader is keyed on the frame counter
+    for (int i = 0; i < numFireworks; ++i) {
+        fireworks[i].first = 0; // every firework spawns into the staging block
+        fireworks[i].rng.seed(seed, i);
+        launch(i);
+    }
+    return true;
+}
+
+void GpuSimulation::update(float dt) {
+    TRACE_SCOPE("gpu update");
+    int next = 1 - current;
+
+    // advance every particle on the GPU
+    program.use();
+    program.set(particlesLocation, 0);
+    program.set(dtLocation, dt);
+    glUniform1ui(frameLocation, frame++);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, stateTextures[current]);
+    glBindVertexArray(updateVAOs[current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, stateBuffers[next]);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, capacity);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+    current = next;
+
+    // follow each firework with the same arithmetic as the shader and spawn on its events
+    for (size_t i = 0; i < fireworks.size(); ++i) {
+        Firework &firework = fireworks[i];
+        Lifecycle &lifecycle = lifecycles[i];
+        const FireworkType &params = config.types[firework.type];
+
+        if (!firework.exploded) {
+            lifecycle.velY += params.gravity * dt;
+            lifecycle.x += lifecycle.velX * dt;
+            lifecycle.y += lifecycle.velY * dt;
+            if (lifecycle.velY >= 0) continue;
+
+            // the rocket starts falling: burst at its current position
+            uint32_t numStale = firework.numLive();
+            staging.posX[firework.first] = lifecycle.x;
+            staging.posY[firework.first] = lifecycle.y;
+            firework.explode(staging, params);
+            lifecycle.life = 1.0f;
+            upload(i, firework.numLive(), numStale);
+        } else {
+            lifecycle.life -= params.explosionDecayRate * dt;
+            if (lifecycle.life <= 0) launch(i);
+        }
+    }
+}
+
+// launch a new rocket, clearing out whatever the previous one left behind
+void GpuSimulation::launch(int i) {
+    Firework &firework = fireworks[i];
+    uint32_t numStale = firework.numLive();
+    firework.type = config.pickType(firework.rng);
+    firework.reset(staging, config.types[firework.type]);
+
+    uint32_t rocket = firework.first;
+    lifecycles[i] = {staging.posX[rocket], staging.posY[rocket], staging.velX[0], staging.velY[0], 1.0f};
+    upload(i, firework.numLive(), numStale);
+}
+
+// copy a firework's particles from the staging block into the latest state
+// buffer, killing any particles past numLive that were live before
+void GpuSimulation::upload(int i, uint32_t numLive, uint32_t numStale) {
+    Firework &firework = fireworks[i];
+    const FireworkType &params = config.types[firework.type];
+    uint32_t blockFirst = i * blockSize;
+
+    for (uint32_t p = 0; p < numLive; ++p) {
+        uint32_t s = firework.first + p;
+        GpuParticle &g = uploadBlock[p];
+        bool head = p < (uint32_t) firework.numHeads;
+        uint32_t parent = head ? p : p % firework.numHeads; // trail particles follow the head in the same place of their ring
+
+        // trail particles start with their head's velocity; the shader takes it from the head every step
+        g = {staging.posX[s], staging.posY[s], head ? staging.scale[parent] : TRAIL_SCALE, staging.life[s],
+            (float) i, {0.f, 0.f}, staging.alpha[s] / 255.f,
+            staging.velX[parent], staging.velY[parent], head ? staging.origVelX[parent] : 0.f, head ? staging.origVelY[parent] : 0.f,
+            staging.decayRate[s], (float) (blockFirst + parent), 0.f, 0.f};
+        g.kind = head ? (firework.exploded ? GPU_EXPLOSION : GPU_ROCKET) : GPU_TRAIL;
+        if (g.kind == GPU_ROCKET) g.mode = params.gravity;
+        else if (g.kind == GPU_EXPLOSION) g.mode = params.drag * NUM_FADE_MODES + params.fade;
+        else g.mode = params.fade;
+    }
+
+    uint32_t count = max(numLive, numStale);
+    fill(uploadBlock.begin() + numLive, uploadBlock.begin() + count, GpuParticle());
+
+    glBindBuffer(GL_ARRAY_BUFFER, stateBuffers[current]);
+    glBufferSubData(GL_ARRAY_BUFFER, blockFirst * sizeof(GpuParticle), count * sizeof(GpuParticle), uploadBlock.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+size_t GpuSimulation::numLiveParticles() const {
+    size_t count = 0;
+    for (auto &firework : fireworks) count += firework.numLive();
+    return count;
+}
+
+void GpuSimulation::close() {
+    program.destroy();
+    glDeleteVertexArrays(2, updateVAOs);
+    glDeleteTextures(2, stateTextures);
+    glDeleteBuffers(2, stateBuffers);
+}
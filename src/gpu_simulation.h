@@ -0,0 +1,66 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+#include "firework.h"
+#include "firework_config.h"
+#include "particle_system.h"
+#include "shader_program.h"
+
+// Particle state as stored in the GPU buffers, 64 bytes per particle
+struct GpuParticle {
+    float x, y, scale, life;
+    float palette, unused[2], alpha; // palette: the firework's entry in the renderer's palette
+    float velX, velY, origVelX, origVelY;
+    float decayRate, parent, kind;
+    float mode; // rockets: gravity, which their trails also read; explosion particles: drag * NUM_FADE_MODES + fade; trails: fade
+};
+
+// parent indices and palette entries are stored as floats, which hold every
+// integer up to 2^24 exactly
+const uint32_t MAX_GPU_PARTICLES = 1u << 24;
+
+enum GpuParticleKind { GPU_DEAD = 0, GPU_ROCKET = 1, GPU_EXPLOSION = 2, GPU_TRAIL = 3 };
+
+// Simulation backend that keeps every particle in GL buffers and advances them
+// with a transform feedback pass (shaders/simulate.glsl) that ping-pongs
+// between two state buffers. The CPU only follows each rocket and the life of
+// each explosion to decide when a firework explodes or relaunches, and then
+// writes that firework's block of particles; nothing is read back.
+struct GpuSimulation {
+    // spawn rules and colors come from Firework, run against a one-block staging ParticleSystem
+    FireworkConfig config;
+    std::vector<Firework> fireworks;
+    struct Lifecycle {
+        float x, y, velX, velY; // rocket
+        float life; // life of the explosion particles
+    };
+    std::vector<Lifecycle> lifecycles;
+    ParticleSystem staging;
+    std::vector<GpuParticle> uploadBlock;
+
+    uint32_t blockSize = 0; // firework i owns particles [i * blockSize, (i + 1) * blockSize)
+    uint32_t capacity = 0;
+    int current = 0; // state buffer holding the latest particles
+    GLuint stateBuffers[2] = {0, 0};
+    GLuint stateTextures[2] = {0, 0}; // buffer textures over stateBuffers for reading heads
+    GLuint updateVAOs[2] = {0, 0};
+    uint32_t frame = 0;
+
+    ShaderProgram program;
+    GLint particlesLocation = -1, dtLocation = -1, frameLocation = -1;
+
+    // needs a current GL context
+    bool init(const FireworkConfig &config, uint64_t seed = 1);
+    void update(float dt);
+    void close();
+
+    GLuint stateBuffer() const { return stateBuffers[current]; }
+    size_t numLiveParticles() const;
+
+private:
+    void launch(int i);
+    void upload(int i, uint32_t numLive, uint32_t numStale);
+};
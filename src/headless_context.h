@@ -0,0 +1,20 @@
+#pragma once
+
+#include <EGL/egl.h>
+#include <GL/glew.h>
+
+// OpenGL 3.3 core context with no window or display server, through EGL's
+// surfaceless platform (Mesa's llvmpipe runs it without a GPU). Everything is
+// drawn into an offscreen framebuffer that stays bound.
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+    GLuint framebuffer = 0, colorBuffer = 0;
+    int width = 0, height = 0;
+
+    // create the context and make it current; the framebuffer needs GL
+    // functions, so it is created separately once GLEW is loaded
+    bool init();
+    bool createFramebuffer(int width, int height);
+    void close();
+};
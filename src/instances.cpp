@@ -0,0 +1,32 @@
+#include "instances.h"
+
+#include <algorithm>
+
+using namespace std;
+
+size_t buildInstances(const Simulation &simulation, ParticleInstance *out, float interpolation, const Bounds &view) {
+    const ParticleSystem &ps = simulation.particles;
+    ParticleInstance *instance = out;
+
+    // gather the live particles of every firework block
+    for (size_t f = 0; f < simulation.fireworks.size(); ++f) {
+        const Firework &firework = simulation.fireworks[f];
+        uint8_t palette[3] = {(uint8_t) f, (uint8_t) (f >> 8), (uint8_t) (f >> 16)};
+        uint32_t heads = ps.heads(firework.first);
+        uint32_t trails = firework.first + firework.numHeads;
+        uint32_t end = firework.first + firework.numLive();
+        for (uint32_t i = firework.first; i < end; ++i) {
+            float x = ps.posX[i];
+            float y = ps.posY[i];
+            if (ps.interpolated) {
+                x = ps.prevPosX[i] + (x - ps.prevPosX[i]) * interpolation;
+                y = ps.prevPosY[i] + (y - ps.prevPosY[i]) * interpolation;
+            }
+            float scale = i < trails ? ps.scale[heads + (i - firework.first)] : TRAIL_SCALE;
+            if (!view.overlaps(x, y, scale)) continue;
+
+            *instance++ = {x, y, scale, ps.alpha[i], {palette[0], palette[1], palette[2]}};
+        }
+    }
+    return instance - out;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bounds.h"
+#include "simulation.h"
+
+// Per-instance attributes uploaded for every particle drawn in a frame. The
+// color is looked up in the renderer's palette, which holds the color of
+// firework i in entry i.
+struct ParticleInstance {
+    float x, y;
+    float scale;
+    uint8_t alpha; // 255 is opaque
+    uint8_t palette[3]; // palette entry, least significant byte first
+};
+
+// Write an instance for every live particle that overlaps view into out,
+// which must have room for simulation.particles.size() instances, and return
+// how many were written. Positions are blended between the previous and the
+// latest step by interpolation (0 = previous, 1 = latest) unless the
+// particles are stored without their previous positions. This is a
+// read-only pass over the simulation that never allocates.
+size_t buildInstances(const Simulation &simulation, ParticleInstance *out, float interpolation = 1.0f,
+        const Bounds &view = Bounds());
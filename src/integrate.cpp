@@ -0,0 +1,331 @@
+#include "integrate.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FIREWORKS_X86 1
+#include <immintrin.h>
+#endif
+
+#include <cstring>
+
+using namespace std;
+
+namespace {
+
+// Kernels index every array from 0; the pointers are offset to the start of
+// the range. Trail particle i follows head i, whose velocity and life are
+// read from the head's own arrays. Life is a float or, with
+// ParticleSystem::quantizedLife, a uint16_t.
+template <typename Life>
+struct TrailArrays {
+    float *posX, *posY;
+    const float *headVelX, *headVelY;
+    const Life *headLife;
+    Life *life;
+    uint8_t *alpha;
+    const float *decayRate;
+};
+
+template <typename Life>
+struct ExplosionArrays {
+    float *posX, *posY;
+    float *velX, *velY;
+    const float *origVelX, *origVelY;
+    Life *life;
+    uint8_t *alpha;
+    const float *decayRate;
+};
+
+template <typename Life>
+using TrailKernel = void (*)(const TrailArrays<Life> &, uint32_t, uint32_t, float);
+template <typename Life>
+using ExplosionKernel = void (*)(const ExplosionArrays<Life> &, uint32_t, uint32_t, float);
+
+// life as stored, with the same rounding as quantizeLife() and dequantizeLife()
+float loadLife(const float *life) { return *life; }
+float loadLife(const uint16_t *life) { return dequantizeLife(*life); }
+void storeLife(float *out, float life) { *out = life; }
+void storeLife(uint16_t *out, float life) { *out = quantizeLife(life); }
+
+// The drag and fade policies are template parameters, so each instantiation
+// is a straight loop with no per-particle branching on the firework type. The
+// vector versions multiply in the same order as the scalar ones to stay
+// bit-identical.
+
+template <DragModel drag>
+float dragVelocity(float life, float origVel, float dt) {
+    if constexpr (drag == DRAG_NONE) return origVel * dt;
+    else if constexpr (drag == DRAG_QUADRATIC) return life * life * origVel * dt;
+    else return life * origVel * dt;
+}
+
+template <FadeMode fade>
+float fadeAlpha(float life) {
+    if constexpr (fade == FADE_QUADRATIC) return life * life;
+    else return life;
+}
+
+template <FadeMode fade, typename Life>
+void trailScalar(const TrailArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    for (; i < end; ++i) {
+        float life = loadLife(a.life + i);
+        float headLife = loadLife(a.headLife + i);
+        a.posX[i] += life * a.headVelX[i] * dt;
+        a.posY[i] += life * a.headVelY[i] * dt;
+        life = life > headLife ? headLife : life; // restrict alpha value of trailing particles
+        a.alpha[i] = alphaByte(fadeAlpha<fade>(life));
+        storeLife(a.life + i, life - a.decayRate[i] * dt);
+    }
+}
+
+template <DragModel drag, FadeMode fade, typename Life>
+void explosionScalar(const ExplosionArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    for (; i < end; ++i) {
+        float life = loadLife(a.life + i);
+        a.velX[i] = dragVelocity<drag>(life, a.origVelX[i], dt); // decrease speed of the particle over time
+        a.velY[i] = dragVelocity<drag>(life, a.origVelY[i], dt);
+        a.posX[i] += a.velX[i];
+        a.posY[i] += a.velY[i];
+        a.alpha[i] = alphaByte(fadeAlpha<fade>(life));
+        storeLife(a.life + i, life - a.decayRate[i] * dt);
+    }
+}
+
+#ifdef FIREWORKS_X86
+template <DragModel drag>
+__m128 dragVelocity(__m128 life, __m128 origVel, __m128 dt) {
+    if constexpr (drag == DRAG_NONE) return _mm_mul_ps(origVel, dt);
+    else if constexpr (drag == DRAG_QUADRATIC) return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(life, life), origVel), dt);
+    else return _mm_mul_ps(_mm_mul_ps(life, origVel), dt);
+}
+
+template <FadeMode fade>
+__m128 fadeAlpha(__m128 life) {
+    if constexpr (fade == FADE_QUADRATIC) return _mm_mul_ps(life, life);
+    else return life;
+}
+
+// alphaByte() for 4 and 8 lanes, with the same float operations
+void storeAlpha(uint8_t *out, __m128 alpha) {
+    __m128 clamped = _mm_min_ps(_mm_max_ps(alpha, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    __m128i scaled = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+    __m128i words = _mm_packs_epi32(scaled, scaled);
+    int32_t bytes = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+    memcpy(out, &bytes, sizeof(bytes));
+}
+
+__attribute__((target("avx2")))
+void storeAlpha(uint8_t *out, __m256 alpha) {
+    __m256 clamped = _mm256_min_ps(_mm256_max_ps(alpha, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    __m256i scaled = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, _mm256_set1_ps(255.f)), _mm256_set1_ps(0.5f)));
+    __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(scaled), _mm256_extracti128_si256(scaled, 1));
+    _mm_storel_epi64((__m128i *) out, _mm_packus_epi16(words, words));
+}
+
+// loadLife() and storeLife() for 4 and 8 lanes, with the same float operations
+__m128 loadLife4(const float *life) { return _mm_loadu_ps(life); }
+
+__m128 loadLife4(const uint16_t *life) {
+    __m128i steps = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) life), _mm_setzero_si128());
+    return _mm_div_ps(_mm_cvtepi32_ps(steps), _mm_set1_ps(LIFE_STEPS));
+}
+
+void storeLife(float *out, __m128 life) { _mm_storeu_ps(out, life); }
+
+void storeLife(uint16_t *out, __m128 life) {
+    __m128 clamped = _mm_min_ps(_mm_max_ps(life, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    __m128i steps = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(clamped, _mm_set1_ps(LIFE_STEPS)), _mm_set1_ps(0.5f)));
+    // SSE2 only packs with signed saturation, so pack around zero and move back
+    __m128i centred = _mm_sub_epi32(steps, _mm_set1_epi32(32768));
+    __m128i words = _mm_xor_si128(_mm_packs_epi32(centred, centred), _mm_set1_epi16((short) 0x8000));
+    _mm_storel_epi64((__m128i *) out, words);
+}
+
+__attribute__((target("avx2")))
+__m256 loadLife8(const float *life) { return _mm256_loadu_ps(life); }
+
+__attribute__((target("avx2")))
+__m256 loadLife8(const uint16_t *life) {
+    __m256i steps = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) life));
+    return _mm256_div_ps(_mm256_cvtepi32_ps(steps), _mm256_set1_ps(LIFE_STEPS));
+}
+
+__attribute__((target("avx2")))
+void storeLife(float *out, __m256 life) { _mm256_storeu_ps(out, life); }
+
+__attribute__((target("avx2")))
+void storeLife(uint16_t *out, __m256 life) {
+    __m256 clamped = _mm256_min_ps(_mm256_max_ps(life, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    __m256i steps = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(clamped, _mm256_set1_ps(LIFE_STEPS)), _mm256_set1_ps(0.5f)));
+    _mm_storeu_si128((__m128i *) out, _mm_packus_epi32(_mm256_castsi256_si128(steps), _mm256_extracti128_si256(steps, 1)));
+}
+
+template <DragModel drag>
+__attribute__((target("avx2")))
+__m256 dragVelocity(__m256 life, __m256 origVel, __m256 dt) {
+    if constexpr (drag == DRAG_NONE) return _mm256_mul_ps(origVel, dt);
+    else if constexpr (drag == DRAG_QUADRATIC) return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(life, life), origVel), dt);
+    else return _mm256_mul_ps(_mm256_mul_ps(life, origVel), dt);
+}
+
+template <FadeMode fade>
+__attribute__((target("avx2")))
+__m256 fadeAlpha(__m256 life) {
+    if constexpr (fade == FADE_QUADRATIC) return _mm256_mul_ps(life, life);
+    else return life;
+}
+
+template <FadeMode fade, typename Life>
+void trailSSE2(const TrailArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    __m128 vdt = _mm_set1_ps(dt);
+    for (; i + 4 <= end; i += 4) {
+        __m128 life = loadLife4(a.life + i);
+        __m128 posX = _mm_add_ps(_mm_loadu_ps(a.posX + i), _mm_mul_ps(_mm_mul_ps(life, _mm_loadu_ps(a.headVelX + i)), vdt));
+        __m128 posY = _mm_add_ps(_mm_loadu_ps(a.posY + i), _mm_mul_ps(_mm_mul_ps(life, _mm_loadu_ps(a.headVelY + i)), vdt));
+        life = _mm_min_ps(life, loadLife4(a.headLife + i));
+        _mm_storeu_ps(a.posX + i, posX);
+        _mm_storeu_ps(a.posY + i, posY);
+        storeAlpha(a.alpha + i, fadeAlpha<fade>(life));
+        storeLife(a.life + i, _mm_sub_ps(life, _mm_mul_ps(_mm_loadu_ps(a.decayRate + i), vdt)));
+    }
+    trailScalar<fade>(a, i, end, dt);
+}
+
+template <DragModel drag, FadeMode fade, typename Life>
+void explosionSSE2(const ExplosionArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    __m128 vdt = _mm_set1_ps(dt);
+    for (; i + 4 <= end; i += 4) {
+        __m128 life = loadLife4(a.life + i);
+        __m128 velX = dragVelocity<drag>(life, _mm_loadu_ps(a.origVelX + i), vdt);
+        __m128 velY = dragVelocity<drag>(life, _mm_loadu_ps(a.origVelY + i), vdt);
+        _mm_storeu_ps(a.velX + i, velX);
+        _mm_storeu_ps(a.velY + i, velY);
+        _mm_storeu_ps(a.posX + i, _mm_add_ps(_mm_loadu_ps(a.posX + i), velX));
+        _mm_storeu_ps(a.posY + i, _mm_add_ps(_mm_loadu_ps(a.posY + i), velY));
+        storeAlpha(a.alpha + i, fadeAlpha<fade>(life));
+        storeLife(a.life + i, _mm_sub_ps(life, _mm_mul_ps(_mm_loadu_ps(a.decayRate + i), vdt)));
+    }
+    explosionScalar<drag, fade>(a, i, end, dt);
+}
+
+template <FadeMode fade, typename Life>
+__attribute__((target("avx2")))
+void trailAVX2(const TrailArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    __m256 vdt = _mm256_set1_ps(dt);
+    for (; i + 8 <= end; i += 8) {
+        __m256 life = loadLife8(a.life + i);
+        __m256 posX = _mm256_add_ps(_mm256_loadu_ps(a.posX + i), _mm256_mul_ps(_mm256_mul_ps(life, _mm256_loadu_ps(a.headVelX + i)), vdt));
+        __m256 posY = _mm256_add_ps(_mm256_loadu_ps(a.posY + i), _mm256_mul_ps(_mm256_mul_ps(life, _mm256_loadu_ps(a.headVelY + i)), vdt));
+        life = _mm256_min_ps(life, loadLife8(a.headLife + i));
+        _mm256_storeu_ps(a.posX + i, posX);
+        _mm256_storeu_ps(a.posY + i, posY);
+        storeAlpha(a.alpha + i, fadeAlpha<fade>(life));
+        storeLife(a.life + i, _mm256_sub_ps(life, _mm256_mul_ps(_mm256_loadu_ps(a.decayRate + i), vdt)));
+    }
+    trailSSE2<fade>(a, i, end, dt);
+}
+
+template <DragModel drag, FadeMode fade, typename Life>
+__attribute__((target("avx2")))
+void explosionAVX2(const ExplosionArrays<Life> &a, uint32_t i, uint32_t end, float dt) {
+    __m256 vdt = _mm256_set1_ps(dt);
+    for (; i + 8 <= end; i += 8) {
+        __m256 life = loadLife8(a.life + i);
+        __m256 velX = dragVelocity<drag>(life, _mm256_loadu_ps(a.origVelX + i), vdt);
+        __m256 velY = dragVelocity<drag>(life, _mm256_loadu_ps(a.origVelY + i), vdt);
+        _mm256_storeu_ps(a.velX + i, velX);
+        _mm256_storeu_ps(a.velY + i, velY);
+        _mm256_storeu_ps(a.posX + i, _mm256_add_ps(_mm256_loadu_ps(a.posX + i), velX));
+        _mm256_storeu_ps(a.posY + i, _mm256_add_ps(_mm256_loadu_ps(a.posY + i), velY));
+        storeAlpha(a.alpha + i, fadeAlpha<fade>(life));
+        storeLife(a.life + i, _mm256_sub_ps(life, _mm256_mul_ps(_mm256_loadu_ps(a.decayRate + i), vdt)));
+    }
+    explosionSSE2<drag, fade>(a, i, end, dt);
+}
+#endif
+
+// every policy combination, instantiated up front for each instruction set and life encoding
+#define TRAIL_KERNELS(kernel, Life) {kernel<FADE_LINEAR, Life>, kernel<FADE_QUADRATIC, Life>}
+#define EXPLOSION_KERNELS(kernel, Life) { \
+    {kernel<DRAG_LIFE, FADE_LINEAR, Life>, kernel<DRAG_LIFE, FADE_QUADRATIC, Life>}, \
+    {kernel<DRAG_NONE, FADE_LINEAR, Life>, kernel<DRAG_NONE, FADE_QUADRATIC, Life>}, \
+    {kernel<DRAG_QUADRATIC, FADE_LINEAR, Life>, kernel<DRAG_QUADRATIC, FADE_QUADRATIC, Life>}, \
+}
+
+template <typename Life>
+const TrailKernel<Life> trailKernels[][NUM_FADE_MODES] = {
+    TRAIL_KERNELS(trailScalar, Life),
+#ifdef FIREWORKS_X86
+    TRAIL_KERNELS(trailSSE2, Life), TRAIL_KERNELS(trailAVX2, Life),
+#endif
+};
+
+template <typename Life>
+const ExplosionKernel<Life> explosionKernels[][NUM_DRAG_MODELS][NUM_FADE_MODES] = {
+    EXPLOSION_KERNELS(explosionScalar, Life),
+#ifdef FIREWORKS_X86
+    EXPLOSION_KERNELS(explosionSSE2, Life), EXPLOSION_KERNELS(explosionAVX2, Life),
+#endif
+};
+
+IntegrateKernel currentKernel = bestIntegrateKernel();
+
+template <typename Life>
+void integrateTrails(ParticleSystem &ps, Life *life, uint32_t first, uint32_t numHeads, uint32_t begin, uint32_t end,
+        float dt, FadeMode fade) {
+    TrailKernel<Life> kernel = trailKernels<Life>[currentKernel][fade];
+    uint32_t heads = ps.heads(first);
+    for (uint32_t ring = begin; ring < end; ring += numHeads) {
+        TrailArrays<Life> a = {&ps.posX[ring], &ps.posY[ring], &ps.velX[heads], &ps.velY[heads], life + first,
+            life + ring, &ps.alpha[ring], &ps.decayRate[ring]};
+        kernel(a, 0, numHeads, dt);
+    }
+}
+
+template <typename Life>
+void integrateExplosion(ParticleSystem &ps, Life *life, uint32_t first, uint32_t numHeads, float dt,
+        DragModel drag, FadeMode fade) {
+    uint32_t heads = ps.heads(first);
+    ExplosionArrays<Life> a = {&ps.posX[first], &ps.posY[first], &ps.velX[heads], &ps.velY[heads],
+        &ps.origVelX[heads], &ps.origVelY[heads], life + first, &ps.alpha[first], &ps.decayRate[first]};
+    explosionKernels<Life>[currentKernel][drag][fade](a, 0, numHeads, dt);
+}
+
+}
+
+IntegrateKernel bestIntegrateKernel() {
+#ifdef FIREWORKS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return KERNEL_AVX2;
+    return KERNEL_SSE2; // always available on x86-64
+#else
+    return KERNEL_SCALAR;
+#endif
+}
+
+IntegrateKernel integrateKernel() {
+    return currentKernel;
+}
+
+// select a kernel, falling back to the best supported one if it is unavailable
+void setIntegrateKernel(IntegrateKernel kernel) {
+    currentKernel = kernel > bestIntegrateKernel() ? bestIntegrateKernel() : kernel;
+}
+
+const char *integrateKernelName(IntegrateKernel kernel) {
+    switch (kernel) {
+        case KERNEL_SSE2: return "sse2";
+        case KERNEL_AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+void integrateTrailParticles(ParticleSystem &ps, uint32_t first, uint32_t numHeads, uint32_t begin, uint32_t end,
+        float dt, FadeMode fade) {
+    if (ps.quantizedLife) integrateTrails(ps, ps.life16.data(), first, numHeads, begin, end, dt, fade);
+    else integrateTrails(ps, ps.life.data(), first, numHeads, begin, end, dt, fade);
+}
+
+void integrateExplosionParticles(ParticleSystem &ps, uint32_t first, uint32_t numHeads, float dt, DragModel drag, FadeMode fade) {
+    if (ps.quantizedLife) integrateExplosion(ps, ps.life16.data(), first, numHeads, dt, drag, fade);
+    else integrateExplosion(ps, ps.life.data(), first, numHeads, dt, drag, fade);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "particle_system.h"
+
+// Batch integration kernels that advance a contiguous range [begin, end) of
+// particles. Each kernel has a scalar, SSE2 and AVX2 implementation which all
+// produce identical results; the widest one the CPU supports is used unless
+// another is selected with setIntegrateKernel().
+
+enum IntegrateKernel { KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+IntegrateKernel bestIntegrateKernel();
+IntegrateKernel integrateKernel();
+void setIntegrateKernel(IntegrateKernel kernel);
+const char *integrateKernelName(IntegrateKernel kernel);
+
+// How explosion particles slow down: speed proportional to their remaining
+// life, no slowdown, or proportional to life squared
+enum DragModel { DRAG_LIFE, DRAG_NONE, DRAG_QUADRATIC, NUM_DRAG_MODELS };
+
+// How alpha follows life: equal to it, or life squared for a quicker fade
+enum FadeMode { FADE_LINEAR, FADE_QUADRATIC, NUM_FADE_MODES };
+
+// Every kernel is compiled for each drag and fade policy; the policies are
+// chosen once per call rather than per particle.
+
+// Advance the trail particles [begin, end) of the block at first, whole rings
+// of numHeads particles (see firework.h). Trail particle k of a ring moves with
+// head k's velocity, and head k's life caps its own.
+void integrateTrailParticles(ParticleSystem &ps, uint32_t first, uint32_t numHeads, uint32_t begin, uint32_t end,
+        float dt, FadeMode fade = FADE_LINEAR);
+
+// Advance the numHeads explosion particles of the block at first, slowing
+// them down as their life runs out
+void integrateExplosionParticles(ParticleSystem &ps, uint32_t first, uint32_t numHeads, float dt,
+        DragModel drag = DRAG_LIFE, FadeMode fade = FADE_LINEAR);
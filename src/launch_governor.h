@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Holds frame time to a budget by limiting how many fireworks may be in
+// flight. Fireworks over the limit wait on the ground until others burn out,
+// so the show thins out instead of dropping frames. A changed limit only
+// shows up in the frame time once fireworks have burnt out or exploded, so
+// it only shrinks while no more than the limit are in flight, shrinks by a
+// fraction of the overrun rather than all at once, and only grows back
+// slowly while it is holding launches back.
+struct LaunchGovernor {
+    static constexpr float MIN_FRACTION = 0.1f; // of the fireworks, always allowed in flight
+    static constexpr double SMOOTHING = 0.1; // weight of the newest frame in the smoothed frame time
+    static constexpr double HEADROOM = 0.85; // fraction of the budget below which the limit grows
+    static constexpr float RECOVERY = 0.001f; // fraction of the fireworks allowed back per frame with headroom
+
+    double budgetMs; // 0 disables the governor
+    double smoothedMs = 0;
+    float fraction = 1.f; // of the fireworks allowed in flight
+
+    explicit LaunchGovernor(double budgetMs = 0) : budgetMs(budgetMs) {}
+
+    // feed the time a frame took, excluding any wait for the display, and
+    // how many of numFireworks are in flight; launches are only held back
+    // while canThrottle is set
+    void update(double frameMs, int numLaunched, int numFireworks, bool canThrottle = true) {
+        if (budgetMs <= 0) return;
+        smoothedMs = smoothedMs > 0 ? smoothedMs + (frameMs - smoothedMs) * SMOOTHING : frameMs;
+        int current = limit(numFireworks);
+        if (smoothedMs > budgetMs && canThrottle && numLaunched <= current) {
+            float overrun = (float) (1.0 - budgetMs / smoothedMs);
+            fraction = std::max(MIN_FRACTION, fraction * (1.f - overrun * (float) SMOOTHING));
+        } else if (smoothedMs < budgetMs * HEADROOM && numLaunched >= current) {
+            fraction = std::min(1.f, fraction + RECOVERY);
+        }
+    }
+
+    // fireworks allowed in flight out of numFireworks
+    int limit(int numFireworks) const {
+        return std::max(1, (int) std::ceil(fraction * numFireworks));
+    }
+};
@@ -4,265 +4,66 @@
 #include <SDL2/SDL_image.h>
 #include <iostream>
 #include <string>
-#include <fstream>
-#include <sstream>
-#include <stdio.h>
-#include <vector>
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
-#include <iterator>
+#include <cstdlib>
+#include <ctime>
+
+#ifdef FIREWORKS_HEADLESS
+#include "headless_context.h"
+#endif
+#include "constants.h"
+#include "fixed_timestep.h"
+#include "frame_exporter.h"
+#include "launch_governor.h"
+#include "profiler.h"
+#include "profiler_overlay.h"
+#include "renderer.h"
+#include "simulation.h"
+#include "trace.h"
+#include "trail_lod.h"
 
 using namespace std;
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
-const int WORLD_WIDTH = 800;
-const int WORLD_HEIGHT = 600;
-const int NUM_OUTER_CIRCLE_VERTICES = 50; // vertices along the arc of each circle
 
 SDL_Window *window = nullptr;
 SDL_GLContext context = NULL;
-GLuint programObj;
-GLuint VAO, VBO; // vertex array object and vertex buffer objects
-
-// simulation variables
-const glm::vec3 GRAVITY(0.f, -200.f, 0.f);
-const int NUM_FIREWORKS = 10;
-const int MIN_PARTICLES = 30;
-const int MAX_PARTICLES = 50;
-const int NUM_TRAIL_PARTICLES = 15; // for rocket and explosion particles
-const float MIN_SCALE = 1; // min scale of particles
-const int SCALE_RANGE = 2; // range of the scale for particles
-
-// rocket
-const int MAX_INIT_X_VEL = 20;
-const int MIN_INIT_X_VEL = -20;
-const int MAX_INIT_Y_VEL = 500;
-const int MIN_INIT_Y_VEL = 300;
-
-// particles
-const int MIN_MAGNITUDE = 20;
-const int MAX_MAGNITUDE = 200;
-const float EXPLOSION_LIFE_DECREASE_RATE = 0.5; 
-const float TRAIL_MIN_DECREASE_RATE = 3; // min number of respawns per second
-const float TRAIL_MAX_DECREASE_RATE = 6; // max number of respawns per second
-
-// camera variables
-glm::mat4 projection = glm::ortho(0.f, (float) SCREEN_WIDTH, 0.f, (float) SCREEN_HEIGHT, -1.f, 1.f);
-glm::mat4 view = glm::lookAt(
-        glm::vec3(0.f, 0.f, 1.f),
-        glm::vec3(0.f, 0.f, 0.f),
-        glm::vec3(0.f, 1.f, 0.f)
-        );
-
-// Base particle class for explosions and trails
-struct Particle {
-    glm::vec3 pos;
-    glm::vec3 vel;
-    glm::vec4 color;
-    float life = 1.0;
-    float scale;
-    float lifeDecreaseRate;
-
-    Particle(glm::vec3 pos, glm::vec3 vel, glm::vec4 color, float scale) : 
-        pos(pos), vel(vel), color(color), scale(scale) {}
-
-    virtual void update(float dt) {};
-
-    void render() {
-        glm::mat4 model(1.f);
-        model = glm::translate(model, pos);
-        model = glm::scale(model, glm::vec3(scale, scale, 1.f));
-        glm::mat4 mvp = projection * view * model;
-
-        glUniformMatrix4fv(glGetUniformLocation(programObj, "mvp"), 1, GL_FALSE, &mvp[0][0]);
-        glUniform4fv(glGetUniformLocation(programObj, "fragColor"), 1, glm::value_ptr(color));
-        glDrawArrays(GL_TRIANGLE_FAN, 0, NUM_OUTER_CIRCLE_VERTICES + 1);
-    }
-};
-
-// Trailing particles
-struct TrailParticle : public Particle {
-    float lifeDecreaseRate;
-
-    TrailParticle(glm::vec3 pos, glm::vec3 vel, glm::vec4 color, float scale, float lifeDecreaseRate) 
-        : lifeDecreaseRate(lifeDecreaseRate), Particle(pos, vel, color, scale) {}
-
-    virtual void update(float dt, glm::vec3 &sourceVel, float sourceLife) {
-        vel = sourceVel;
-        pos += life * vel * dt;
-        if (life > sourceLife) life = sourceLife; // restrict alpha value of trailing particles
-        color.w = life;
-        life -= lifeDecreaseRate * dt;
-    }
-};
-
-// Explosion particles
-struct ExplosionParticle : public Particle {
-    glm::vec3 origVel;
-    vector<TrailParticle> trailParticles;
-
-    ExplosionParticle(glm::vec3 pos, glm::vec3 vel, glm::vec4 color, float scale) 
-        : Particle(pos, vel, color, scale), origVel(vel) {
-            for (int i = 0; i < NUM_TRAIL_PARTICLES; ++i) {
-                float lifeDecrease = (float) rand() / RAND_MAX * (TRAIL_MAX_DECREASE_RATE - TRAIL_MIN_DECREASE_RATE) + TRAIL_MIN_DECREASE_RATE;
-                glm::vec3 particleVel = vel * 0.1f;
-                trailParticles.push_back(TrailParticle(pos, particleVel, color, 1, lifeDecrease));
-            }
-        }
-
-    // relocate a trailing particle to based on current location of the ExplosionParticle object
-    void respawnTrailParticle(TrailParticle &p) {
-        float random = ((rand() % 100) - 50) / 10.0f;
-        p.life = 1.0f;
-        p.pos = pos + random;
-        p.vel = vel * 0.1f;
-    }
-
-    virtual void update(float dt) {
-        for (auto &p : trailParticles) {
-            p.update(dt, vel, life);
-            if (p.life <= 0) respawnTrailParticle(p);
-        }
-
-        vel = life * origVel * dt; // decrease speed of the particle over time
-        pos += vel;
-        color.w = life;
-        life -= EXPLOSION_LIFE_DECREASE_RATE * dt;
-    }
-
-    void render() {
-        for (auto &p : trailParticles) p.render();
-        this->Particle::render();
-    }
-};
-
-// Firework class that maintains the "rocket" and all particles of the firework
-struct Firework {
-    glm::vec3 pos;
-    glm::vec3 vel;
-    glm::vec4 color;
-    float scale;
-    bool exploded = false;
-    int numParticles;
-    vector<TrailParticle> trailParticles;
-    vector<ExplosionParticle> explosionParticles;
-
-    Firework() {
-        reset();
-    }
-
-    void respawnParticle(TrailParticle &p) {
-        float random = ((rand() % 100) - 50) / 10.0f;
-        p.life = 1.0f;
-        p.pos = pos + random;
-        p.vel = vel * ((float) rand() / RAND_MAX * 0.25f + 0.75f);
-    }
-
-    void randomiseColor() {
-        // randomise rgb colors in range [0.25, 1.0]
-        float r = ((float) rand() / RAND_MAX) * 0.75f + 0.25f;
-        float g = ((float) rand() / RAND_MAX) * 0.75f + 0.25f;
-        float b = ((float) rand() / RAND_MAX) * 0.75f + 0.25f;
-        color = glm::vec4(r, g, b, 1.0f);
-    }
-
-    // Destroy exisiting particles and reset firework variables
-    void reset() {
-        for (auto &p : explosionParticles) p.trailParticles.clear();
-        explosionParticles.clear();
-        trailParticles.clear();
-        exploded = false;
-
-        numParticles = rand() % (MAX_PARTICLES - MIN_PARTICLES) + MIN_PARTICLES;
-        pos = glm::vec3((float) (rand() % WORLD_WIDTH), 0.f, 0.f);
-        vel = glm::vec3(rand() % (MAX_INIT_X_VEL - MIN_INIT_X_VEL) + MIN_INIT_X_VEL, rand() % (MAX_INIT_Y_VEL - MIN_INIT_Y_VEL) + MIN_INIT_Y_VEL, 0.f);
-        scale = rand() % SCALE_RANGE + MIN_SCALE;
-
-        randomiseColor();
-
-        for (int i = 0; i < NUM_TRAIL_PARTICLES; ++i) {
-            float lifeDecrease = (float) rand() / RAND_MAX * (TRAIL_MAX_DECREASE_RATE - TRAIL_MIN_DECREASE_RATE) + TRAIL_MIN_DECREASE_RATE;
-            glm::vec3 particleVel = vel * ((float) rand() / RAND_MAX * 0.25f + 0.75f);
-            trailParticles.push_back(TrailParticle(pos, particleVel, color, 1, lifeDecrease));
-        }
-    }
-
-    void update(float dt) {
-        if (exploded)  // update all explosion particles
-            for (auto &p : explosionParticles) { 
-                p.update(dt);
-                if (p.life <= 0) reset();
-            }
-        else { // update the rocket
-            vel += GRAVITY * dt;
-            pos += vel * dt;
-
-            for (auto &p : trailParticles) { 
-                p.update(dt, vel, 1.0f);
-                if (p.life <= 0) respawnParticle(p);
-            }
-
-            if (vel.y < 0) {
-                exploded = true;
-                trailParticles.clear();
-
-                float theta =  M_PI * 2 / (float) NUM_OUTER_CIRCLE_VERTICES;
-
-                // create explosion particles
-                for (int i = 0; i < numParticles; ++i) {
-                    float randTheta = rand() % NUM_OUTER_CIRCLE_VERTICES * theta;   // randomise the direction of the particle
-                    glm::vec3 particleVel = glm::vec3(glm::cos(randTheta), glm::sin(randTheta), 0.f);
-                    particleVel *= rand() % (MAX_MAGNITUDE - MIN_MAGNITUDE) + MIN_MAGNITUDE; // randomise the magnitude of the particle's speed
-                    explosionParticles.push_back(ExplosionParticle(pos, particleVel, color, rand() % SCALE_RANGE + MIN_SCALE));
-                }
-            }
-        }
-    }
-
-    void render() {
-        if (!exploded) {
-            for (auto &p : trailParticles) p.render();
-            glm::mat4 model(1.f);
-            model = glm::translate(model, pos);
-            model = glm::scale(model, glm::vec3(scale, scale, 1.f));
-            glm::mat4 mvp = projection * view * model;
-
-            glUniformMatrix4fv(glGetUniformLocation(programObj, "mvp"), 1, GL_FALSE, &mvp[0][0]);
-            glUniform4fv(glGetUniformLocation(programObj, "fragColor"), 1, glm::value_ptr(color));
-            glDrawArrays(GL_TRIANGLE_FAN, 0, NUM_OUTER_CIRCLE_VERTICES + 1);
-        } else {
-            for (auto &p : explosionParticles) p.render();
-        }
-    }
-};
 
 bool init();
-bool initGL();
-void initFireworks();
-void render();
-void update(float dt);
-void setupGLBuffers();
+bool initFireworks();
 void close();
 
-vector<Firework> fireworks;
-
-bool init() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        cout << "Failed to initialize SDL" << endl;
-        return false;
-    }
-
-    int imgFlags = IMG_INIT_PNG;
-    if (!(IMG_Init(imgFlags) & imgFlags)) {
-        cout << "Failed to initialize SDL_image" << endl;
-        return false;
-    }
-
+FireworkConfig config; // --config: firework types and count, built-in defaults otherwise
+Simulation simulation;
+GpuSimulation gpuSimulation;
+bool useGpuSimulation = false; // --gpu: simulate particles with transform feedback
+size_t particleBytes = 0; // --particle-bytes: storage budget of a particle, 0 for no limit
+bool stress = false; // --stress: enough fireworks for over a million live particles, with capacity stats
+double simulationRate = 60.0; // --sim-rate: simulation steps per second
+int maxStepsPerFrame = 5; // --max-steps: steps run before a slow frame drops the backlog
+Renderer renderer;
+RenderMode renderMode = RENDER_SPRITE; // --render: fan or sprite circles
+Profiler profiler;
+bool showProfiler = false; // toggled with P: per-phase frame time graph
+TrailLod trailLod; // --frame-budget: thins out trails to keep frames within this many ms
+LaunchGovernor launchGovernor; // --frame-budget: then holds back launches
+string profileFile; // --profile: write the recorded frame times here on exit (.csv or .json)
+string traceFile; // --trace: record trace events and write them here on exit
+uint64_t seed = 0; // --seed: master seed of every firework; defaults to the time
+bool headless = false; // --headless: render offscreen through EGL, without a window or event loop
+int headlessFrames = 600; // --frames: frames rendered before a headless run exits
+#ifdef FIREWORKS_HEADLESS
+HeadlessContext headlessContext;
+#endif
+FrameExporter exporter;
+string exportTarget; // --export: PNG pattern, Y4M/RGB file or |command to record every frame to
+string exportFormatName; // --export-format: png, y4m or rgb; guessed from the target if not given
+int exportRate = 60; // --export-fps: frames per simulated second while exporting
+
+bool initWindow() {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3); // 3.3 for instanced vertex attributes
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
 
     window = SDL_CreateWindow("Fireworks", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT,
@@ -278,216 +79,285 @@ bool init() {
         cout << "Failed to create context" << endl;
         return false;
     }
+    return true;
+}
 
-    glewExperimental = GL_TRUE;
-    GLenum glewError = glewInit();
-    if (glewError != GLEW_OK) {
-        cout << "Failed to initialize GLEW" << endl;
+bool init() {
+    if (SDL_Init(headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO) < 0) {
+        cout << "Failed to initialize SDL" << endl;
         return false;
     }
 
-    if (!initGL()) {
-        cout << "Failed to initialize OpenGL and shaders" << endl;
+    int imgFlags = IMG_INIT_PNG;
+    if (!(IMG_Init(imgFlags) & imgFlags)) {
+        cout << "Failed to initialize SDL_image" << endl;
         return false;
     }
-    return true;
-}
-
-// read a file and return its contents as a string
-string fileToString(const string& file) {
-    ifstream ifs(file);
-    stringstream ss;
-
-    while (ifs >> ss.rdbuf());
-    return ss.str();
-}
-
-void printShaderLog(GLuint shader) {
-    if (glIsShader(shader) ) {
-        int infoLogLength = 0;
-        int maxLength = infoLogLength;
-
-        glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &maxLength );
-        char* infoLog = new char[ maxLength ];
-
-        glGetShaderInfoLog( shader, maxLength, &infoLogLength, infoLog );
-        if (infoLogLength > 0) {
-            printf("%s\n", &(infoLog[0]));
-        }
 
-        delete[] infoLog;
-    } else {
-        cout << to_string(shader) << " is not a shader" << endl;
+    if (headless) {
+#ifdef FIREWORKS_HEADLESS
+        if (!headlessContext.init()) return false;
+#else
+        cout << "Built without EGL; --headless is not available" << endl;
+        return false;
+#endif
+    } else if (!initWindow()) {
+        return false;
     }
-}
 
-bool initGL() {
-    glEnable(GL_TEXTURE_2D);
-    GLint compileSuccess;
-    string temp;
-
-    GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
-    temp = fileToString("./shaders/vertex.glsl");
-    const char* vShaderSource = temp.c_str();
-    glShaderSource(vShader, 1, &vShaderSource, NULL);
-    glCompileShader(vShader);
-
-    glGetShaderiv(vShader, GL_COMPILE_STATUS, &compileSuccess);
-    if (!compileSuccess) {
-        cout << "Failed to compile vertex shader" << endl;
-        printShaderLog(vShader);
+    glewExperimental = GL_TRUE;
+    GLenum glewError = glewInit();
+    // GLEW built for GLX loads the GL functions and then fails to find an X
+    // display, which an EGL context does not need
+    if (glewError != GLEW_OK && !(headless && glewError == GLEW_ERROR_NO_GLX_DISPLAY)) {
+        cout << "Failed to initialize GLEW" << endl;
         return false;
     }
 
-    GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
-    temp = fileToString("./shaders/fragment.glsl");
-    const char* fShaderSource = temp.c_str();
-    glShaderSource(fShader, 1, &fShaderSource, NULL);
-    glCompileShader(fShader);
+#ifdef FIREWORKS_HEADLESS
+    if (headless && !headlessContext.createFramebuffer(SCREEN_WIDTH, SCREEN_HEIGHT)) return false;
+#endif
 
-    glGetShaderiv(fShader, GL_COMPILE_STATUS, &compileSuccess);
-    if (!compileSuccess) {
-        cout << "Failed to compile fragment shader" << endl;
-        printShaderLog(fShader);
+    if (!renderer.init(SCREEN_WIDTH, SCREEN_HEIGHT, renderMode)) {
+        cout << "Failed to initialize OpenGL and shaders" << endl;
         return false;
     }
-
-    programObj = glCreateProgram();
-    glAttachShader(programObj, vShader);
-    glAttachShader(programObj, fShader);
-    glLinkProgram(programObj);
-
-    // flag shaders for deletion on program delete
-    glDeleteShader(vShader);
-    glDeleteShader(fShader);
     return true;
 }
 
-// create and initialise the vector of fireworks
-void initFireworks() {
-    for (int i = 0; i < NUM_FIREWORKS; ++i) {
-        fireworks.push_back(Firework());
+bool initExport() {
+    ExportFormat format = EXPORT_PNG;
+    string name = exportFormatName;
+    if (name.empty()) {
+        // guess from the extension of the file name; a name without one is a PNG sequence prefix
+        bool pipe = exportTarget[0] == '|';
+        size_t dot = exportTarget.rfind('.');
+        size_t slash = exportTarget.rfind('/');
+        bool hasExtension = dot != string::npos && (slash == string::npos || dot > slash);
+        string extension = hasExtension ? exportTarget.substr(dot + 1) : "png";
+        name = pipe ? "y4m" : (extension == "raw" ? "rgb" : extension);
     }
-}
-
-void setupGLBuffers() {
-    glCreateVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    // calculate vertices for a circle
-    float vertices[(NUM_OUTER_CIRCLE_VERTICES + 1) * 3];
-
-    // set last vertex to center of circle
-    int len = sizeof(vertices) / sizeof(*vertices);
-    vertices[len - 1] = 0;
-    vertices[len - 2] = 0;
-    vertices[len - 3] = 0;
-
-    float theta = M_PI * 2 / (float) NUM_OUTER_CIRCLE_VERTICES;
-    float cosine = glm::cos(theta);
-    float sine = glm::sin(theta);
-
-    float x = 1;
-    float y = 0;
-
-    for (int i = 0; i < NUM_OUTER_CIRCLE_VERTICES; ++i) {
-        float temp = x;
-        x = x * cosine - y * sine;
-        y = temp * sine + y * cosine;
-
-        vertices[i * 3] = x;
-        vertices[i * 3 + 1] = y;
-        vertices[i * 3 + 2] = 0; // let z axis be 0
+    if (name == "y4m") format = EXPORT_Y4M;
+    else if (name == "rgb") format = EXPORT_RGB;
+    else if (name != "png") {
+        cout << "Unknown export format " << name << " (use png, y4m or rgb, or set one with --export-format)" << endl;
+        return false;
     }
-
-    // create vertex and color buffers
-    glCreateBuffers(1, &VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    return exporter.open(exportTarget, format, SCREEN_WIDTH, SCREEN_HEIGHT, exportRate);
 }
 
-// update all fireworks in the world
-void update(float dt) {
-    for (auto & firework : fireworks) firework.update(dt);
-}
-
-void render() {
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glUseProgram(programObj);
-    glBindVertexArray(VAO);
-
-    glm::mat4 projection = glm::ortho(0.f, (float) SCREEN_WIDTH, 0.f, (float) SCREEN_HEIGHT, -1.f, 1.f);
-    glm::mat4 view = glm::lookAt(
-            glm::vec3(0.f, 0.f, 1.f),
-            glm::vec3(0.f, 0.f, 0.f),
-            glm::vec3(0.f, 1.f, 0.f)
-            );
-
-    for (auto firework : fireworks) firework.render();
-
-    glBindVertexArray(0);
-    glUseProgram(0);
+// create and initialise the fireworks
+bool initFireworks() {
+    if (useGpuSimulation) return gpuSimulation.init(config, seed);
+    double minBytes = Simulation::minParticleBytes(config);
+    if (particleBytes > 0 && particleBytes < minBytes) {
+        cout << "Particles need at least " << minBytes << " bytes" << endl;
+        return false;
+    }
+    if (!simulation.init(config, 0, 0, seed, particleBytes)) return false;
+    renderer.applyCamera(simulation);
+    cout << simulation.particles.size() << " particles of " << simulation.particles.bytesPerParticle() << " bytes"
+            << (simulation.particles.quantizedLife ? " (16-bit life)" : "")
+            << (simulation.particles.interpolated ? "" : " (compact, not interpolated)") << ", "
+            << to_string(simulation.memoryBytes() / 1e6) << " MB in total" << endl;
+    if (stress) {
+        simulation.stagger(STRESS_STAGGER_SECONDS, 1.0f / simulationRate);
+        size_t ringBytes = simulation.particles.size() * NUM_UPLOAD_REGIONS * sizeof(ParticleInstance);
+        cout << "Stress: plus a " << to_string(ringBytes / 1e6) << " MB upload ring" << endl;
+    }
+    return true;
 }
 
 void close() {
     cout << "Shutting down..." << endl;
-    SDL_DestroyWindow(window);
+    if (!profileFile.empty() && !profiler.write(profileFile)) cout << "Failed to write " << profileFile << endl;
+    exporter.close();
+    if (!traceFile.empty() && !writeTrace(traceFile)) cout << "Failed to write " << traceFile << endl;
+    if (useGpuSimulation) gpuSimulation.close();
+    renderer.close();
+
+#ifdef FIREWORKS_HEADLESS
+    headlessContext.close();
+#endif
+    if (window) SDL_DestroyWindow(window);
     window = nullptr;
 
-    glDeleteProgram(programObj);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-
     SDL_Quit();
 }
 
 
 int main(int argc, char ** argv) {
+    int numFireworksOverride = -1; // --fireworks: replaces the count from the config
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--gpu") useGpuSimulation = true;
+        else if (arg == "--stress") stress = true;
+        else if (arg == "--particle-bytes" && i + 1 < argc) particleBytes = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--render" && i + 1 < argc) renderMode = string(argv[++i]) == "fan" ? RENDER_FAN : RENDER_SPRITE;
+        else if (arg == "--sim-rate" && i + 1 < argc) simulationRate = max(1.0, atof(argv[++i]));
+        else if (arg == "--max-steps" && i + 1 < argc) maxStepsPerFrame = atoi(argv[++i]);
+        else if (arg == "--frame-budget" && i + 1 < argc) trailLod.budgetMs = launchGovernor.budgetMs = max(0.0, atof(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc) profileFile = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) traceFile = argv[++i];
+        else if (arg == "--seed" && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--headless") headless = true;
+        else if (arg == "--frames" && i + 1 < argc) headlessFrames = max(1, atoi(argv[++i]));
+        else if (arg == "--export" && i + 1 < argc) exportTarget = argv[++i];
+        else if (arg == "--export-format" && i + 1 < argc) exportFormatName = argv[++i];
+        else if (arg == "--export-fps" && i + 1 < argc) exportRate = max(1, atoi(argv[++i]));
+        else if (arg == "--config" && i + 1 < argc && !config.load(argv[++i])) return 1;
+        else if (arg == "--fireworks" && i + 1 < argc) numFireworksOverride = max(0, atoi(argv[++i]));
+    }
+    // trail detail and launch limits act on the CPU simulation's particle blocks
+    if (useGpuSimulation && trailLod.budgetMs > 0) {
+        cout << "--frame-budget does not work with --gpu" << endl;
+        return 1;
+    }
+    if (stress) config.numFireworks = STRESS_FIREWORKS;
+    if (numFireworksOverride >= 0) config.numFireworks = numFireworksOverride;
+    if (seed == 0) seed = time(0);
+    cout << "Seed " << seed << endl;
+
+    setTraceThreadName("main");
+    if (!traceFile.empty()) startTracing();
+
+    int status = 0;
     if (init()) {
-        srand(time(0));
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE);
         glClearColor(0.f, 0.f, 0.f, 1.0f);
 
         bool quit = false;
         SDL_Event e;
-        Uint32 ticks, prevTicks, prevFrameTicks;
-        short frames = 0;
-        prevTicks = SDL_GetTicks();
-        prevFrameTicks = prevTicks;
-
-        int texWidth, texHeight;
-        setupGLBuffers();
-        initFireworks();
+        renderer.profiler = &profiler;
+        size_t prevReportFrame = 0;
+        size_t prevHeldLaunches = 0;
+        double uploadedBytes = 0; // instance data written since the last report
+        Uint32 prevTicks = SDL_GetTicks();
+
+        FixedTimestep timestep(simulationRate, maxStepsPerFrame);
+        Uint64 frequency = SDL_GetPerformanceFrequency();
+        Uint64 prevCounter = SDL_GetPerformanceCounter();
+
+        if (!initFireworks()) {
+            cout << "Failed to initialize the fireworks" << endl;
+            quit = true;
+            status = 1;
+        } else if (!exportTarget.empty() && !initExport()) {
+            quit = true;
+            status = 1;
+        }
 
         SDL_StartTextInput();
         while (!quit) {
-            while (SDL_PollEvent(&e) != 0) {
-                if (e.type == SDL_QUIT) quit = true;
+            TRACE_SCOPE("frame");
+            profiler.beginFrame();
+            {
+                TRACE_SCOPE("events");
+                ScopedTimer timer(&profiler, PHASE_EVENTS);
+                while (!headless && SDL_PollEvent(&e) != 0) {
+                    if (e.type == SDL_QUIT) quit = true;
+                    else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_p) showProfiler = !showProfiler;
+                }
             }
-            // performance measuring
-            frames++;
-            ticks = SDL_GetTicks();
-            float deltaTime = (ticks - prevFrameTicks) / 1000.0; // change in time (seconds)
-            prevFrameTicks = ticks;
-
-            if (ticks - prevTicks >= 1000) { // for every second
-                cout << to_string(1000.0 / frames) << " ms/frame" << endl;
-                frames = 0;
+
+            // performance measuring: mean phase times over the last second
+            Uint32 ticks = SDL_GetTicks();
+            if (ticks - prevTicks >= 1000 && profiler.totalFrames > prevReportFrame) {
+                Profiler::Frame mean = profiler.average(profiler.totalFrames - prevReportFrame);
+                cout << to_string(mean.totalMs) << " ms/frame (";
+                for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) {
+                    cout << (phase ? ", " : "") << profilePhaseName(phase) << " " << to_string(mean.phaseMs[phase]);
+                }
+                cout << ")";
+                if (trailLod.budgetMs > 0) {
+                    cout << ", trail detail " << to_string(trailLod.detail) << ", launches limited to "
+                            << simulation.maxLaunched << " of " << simulation.fireworks.size() << " fireworks ("
+                            << simulation.numHeldLaunches - prevHeldLaunches << " held back)";
+                    prevHeldLaunches = simulation.numHeldLaunches;
+                }
+                if (stress && !useGpuSimulation) {
+                    double frames = profiler.totalFrames - prevReportFrame;
+                    double uploadSeconds = mean.phaseMs[PHASE_UPLOAD] * frames / 1000.0;
+                    cout << ", " << simulation.numLiveParticles() << " live particles, "
+                            << to_string(uploadedBytes / frames / 1e6) << " MB/frame uploaded at "
+                            << to_string(uploadSeconds > 0 ? uploadedBytes / uploadSeconds / 1e9 : 0) << " GB/s";
+                }
+                uploadedBytes = 0;
+                cout << endl;
+                prevReportFrame = profiler.totalFrames;
                 prevTicks = ticks;
             }
 
-            update(deltaTime);
-            render();
+            // run as many fixed steps as the elapsed time covers; headless
+            // runs take exactly one step a frame and exports advance by one
+            // export frame, however long frames take
+            Uint64 counter = SDL_GetPerformanceCounter();
+            double frameSeconds = exporter.isOpen() ? 1.0 / exportRate : (double) (counter - prevCounter) / frequency;
+            bool oneStep = headless && !exporter.isOpen();
+            int steps = oneStep ? 1 : timestep.advance(frameSeconds);
+            float interpolation = oneStep ? 1.0f : timestep.interpolation();
+            prevCounter = counter;
+
+            if (useGpuSimulation) {
+                {
+                    ScopedTimer timer(&profiler, PHASE_UPDATE);
+                    for (int i = 0; i < steps; ++i) gpuSimulation.update(timestep.stepSeconds());
+                }
+                renderer.render(gpuSimulation);
+            } else {
+                {
+                    ScopedTimer timer(&profiler, PHASE_UPDATE);
+                    for (int i = 0; i < steps; ++i) simulation.update(timestep.stepSeconds());
+                }
+                renderer.render(simulation, interpolation);
+                uploadedBytes += renderer.numDrawn * sizeof(ParticleInstance) + renderer.palette.size() * sizeof(uint32_t);
+            }
+
+            if (exporter.isOpen()) {
+                ScopedTimer timer(&profiler, PHASE_EXPORT);
+                exporter.capture();
+                if (exporter.hasFailed()) exporter.close(); // carry on in real time
+            }
+
+            if (showProfiler) {
+                ScopedTimer timer(&profiler, PHASE_DRAW);
+                // mark the frame budget the controllers steer to, if one was given
+                double targetMs = trailLod.budgetMs > 0 ? trailLod.budgetMs : 1000.0 / simulationRate;
+                drawProfilerOverlay(profiler, SCREEN_WIDTH, SCREEN_HEIGHT, targetMs);
+            }
+
+            {
+                TRACE_SCOPE("swap");
+                ScopedTimer timer(&profiler, PHASE_SWAP);
+                if (headless) glFinish(); // nothing to present, but wait for the frame like a swap would
+                else SDL_GL_SwapWindow(window);
+            }
+            profiler.endFrame();
+
+            // trail detail follows the work done in a frame, not the wait for vsync
+            const Profiler::Frame &last = profiler.frame(0);
+            double workMs = last.totalMs - last.phaseMs[PHASE_SWAP];
+            trailLod.update(workMs);
+            simulation.trailDetail = trailLod.detail;
 
-            SDL_GL_SwapWindow(window);
+            // launches are only held back once trails cannot thin out any further
+            launchGovernor.update(workMs, simulation.numLaunched(), simulation.fireworks.size(),
+                    trailLod.detail <= TrailLod::MIN_DETAIL);
+            simulation.maxLaunched = launchGovernor.limit(simulation.fireworks.size());
+
+            if (headless && profiler.totalFrames >= (size_t) headlessFrames) quit = true;
         }
         SDL_StopTextInput();
+
+        if (headless && profiler.count > 0) {
+            cout << "Rendered " << profiler.totalFrames << " frames, " << to_string(profiler.average(profiler.count).totalMs)
+                    << " ms/frame over the last " << profiler.count << endl;
+        }
+    } else {
+        status = 1;
     }
 
     close();
-    return 0;
+    return status;
 }
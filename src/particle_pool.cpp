@@ -0,0 +1,25 @@
+#include "particle_pool.h"
+
+void ParticlePool::init(ParticleSystem &ps, size_t numBlocks, uint32_t blockSize) {
+    this->blockSize = blockSize;
+    ps.resize(numBlocks, blockSize);
+
+    // reserve up front so releasing a block never reallocates the free list
+    freeBlocks.clear();
+    freeBlocks.shrink_to_fit();
+    freeBlocks.reserve(numBlocks);
+
+    // push in reverse so blocks are handed out from the start of the arrays
+    for (size_t i = numBlocks; i > 0; --i) freeBlocks.push_back((uint32_t) ((i - 1) * blockSize));
+}
+
+uint32_t ParticlePool::acquire() {
+    if (freeBlocks.empty()) return NO_BLOCK;
+    uint32_t first = freeBlocks.back();
+    freeBlocks.pop_back();
+    return first;
+}
+
+void ParticlePool::release(uint32_t first) {
+    freeBlocks.push_back(first);
+}
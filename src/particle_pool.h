@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "particle_system.h"
+
+// Fixed-capacity pool of equally sized particle blocks. The ParticleSystem is
+// sized once in init(); after that blocks are handed out and reclaimed through
+// a free list, so launching and retiring fireworks never allocates.
+struct ParticlePool {
+    static const uint32_t NO_BLOCK = UINT32_MAX;
+
+    uint32_t blockSize = 0;
+    std::vector<uint32_t> freeBlocks; // first particle index of every free block
+
+    // size ps for numBlocks blocks of blockSize particles and mark them all free
+    void init(ParticleSystem &ps, size_t numBlocks, uint32_t blockSize);
+
+    // take a free block, returning its first particle index or NO_BLOCK if the pool is exhausted
+    uint32_t acquire();
+    void release(uint32_t first);
+
+    size_t numBlocks() const { return freeBlocks.capacity(); }
+    size_t numFree() const { return freeBlocks.size(); }
+};
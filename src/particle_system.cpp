@@ -0,0 +1,44 @@
+#include "particle_system.h"
+
+template <typename T>
+static size_t bytes(const std::vector<T> &v) {
+    return v.capacity() * sizeof(T);
+}
+
+void ParticleSystem::resize(size_t numBlocks, uint32_t blockSize) {
+    this->blockSize = blockSize;
+    size_t count = numBlocks * blockSize;
+    posX.resize(count);
+    posY.resize(count);
+    prevPosX.resize(interpolated ? count : 0);
+    prevPosY.resize(interpolated ? count : 0);
+    life.resize(quantizedLife ? 0 : count);
+    life16.resize(quantizedLife ? count : 0);
+    decayRate.resize(count);
+    alpha.resize(count);
+
+    size_t numHeads = numBlocks * headsPerBlock;
+    velX.resize(numHeads);
+    velY.resize(numHeads);
+    origVelX.resize(numHeads);
+    origVelY.resize(numHeads);
+    scale.resize(numHeads);
+}
+
+size_t ParticleSystem::memoryBytes() const {
+    return bytes(posX) + bytes(posY) + bytes(prevPosX) + bytes(prevPosY) + bytes(life) + bytes(life16) + bytes(decayRate)
+        + bytes(alpha) + bytes(velX) + bytes(velY) + bytes(origVelX) + bytes(origVelY) + bytes(scale);
+}
+
+void ParticleSystem::move(uint32_t dst, uint32_t src) {
+    posX[dst] = posX[src];
+    posY[dst] = posY[src];
+    if (interpolated) {
+        prevPosX[dst] = prevPosX[src];
+        prevPosY[dst] = prevPosY[src];
+    }
+    if (quantizedLife) life16[dst] = life16[src];
+    else life[dst] = life[src];
+    decayRate[dst] = decayRate[src];
+    alpha[dst] = alpha[src];
+}
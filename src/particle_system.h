@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Color {
+    float r, g, b;
+};
+
+const float TRAIL_SCALE = 1.f; // size of every trail particle
+
+// alpha in [0, 1] as stored, 255 being opaque
+inline uint8_t alphaByte(float alpha) {
+    float clamped = alpha < 0.f ? 0.f : alpha > 1.f ? 1.f : alpha;
+    return (uint8_t) (int) (clamped * 255.f + 0.5f);
+}
+
+// life in [0, 1] as stored by a layout with quantizedLife, in steps of
+// 1 / LIFE_STEPS; life that has run out is stored as 0
+const float LIFE_STEPS = 65535.f;
+
+inline uint16_t quantizeLife(float life) {
+    float clamped = life < 0.f ? 0.f : life > 1.f ? 1.f : life;
+    return (uint16_t) (int) (clamped * LIFE_STEPS + 0.5f);
+}
+
+inline float dequantizeLife(uint16_t life) {
+    return life / LIFE_STEPS;
+}
+
+// Structure-of-arrays storage for every particle in the simulation, in blocks
+// of blockSize particles; each Firework owns one, see firework.h for its
+// layout. Only the first headsPerBlock particles of a block can be heads, and
+// only heads move on their own, so velocities and scale live in head arrays
+// with headsPerBlock entries per block: head h of the block at first is at
+// heads(first) + h. Trail particles move with their head's velocity and all
+// have TRAIL_SCALE. A particle's color is its firework's, and the head a
+// trail particle follows is given by its place in the block, so neither is
+// stored.
+//
+// Two parts of the layout are chosen before resize() to trade quality for
+// memory: interpolated keeps the previous positions, and quantizedLife keeps
+// life in 16 bits (life16) instead of a float (life). Use lifeAt() and
+// setLife() to reach life in either layout.
+struct ParticleSystem {
+    // bytes every particle takes besides its life, its life in either
+    // encoding, the previous positions of an interpolated particle, and every
+    // head slot
+    static const size_t BYTES_PER_PARTICLE = 3 * sizeof(float) + sizeof(uint8_t);
+    static const size_t BYTES_PER_LIFE = sizeof(float);
+    static const size_t BYTES_PER_QUANTIZED_LIFE = sizeof(uint16_t);
+    static const size_t BYTES_PER_INTERPOLATED = 2 * sizeof(float);
+    static const size_t BYTES_PER_HEAD = 5 * sizeof(float);
+
+    // every particle
+    std::vector<float> posX, posY;
+    std::vector<float> prevPosX, prevPosY; // position before the last step, for render interpolation; empty unless interpolated
+    std::vector<float> life; // empty if quantizedLife
+    std::vector<uint16_t> life16; // see quantizeLife(); empty unless quantizedLife
+    std::vector<float> decayRate; // life lost per second
+    std::vector<uint8_t> alpha; // see alphaByte()
+
+    // heads only
+    std::vector<float> velX, velY;
+    std::vector<float> origVelX, origVelY; // launch velocity of explosion particles
+    std::vector<float> scale;
+
+    uint32_t blockSize = 0;
+    uint32_t headsPerBlock = 1; // set before resize()
+    bool interpolated = true; // keep prevPosX/Y; set before resize()
+    bool quantizedLife = false; // keep life in life16; set before resize()
+
+    void resize(size_t numBlocks, uint32_t blockSize);
+    size_t size() const { return posX.size(); }
+    // index of the first head of the block at `first` in the head arrays
+    uint32_t heads(uint32_t first) const { return first / blockSize * headsPerBlock; }
+
+    // mean storage of a particle, head slots included, for a layout
+    static double bytesPerParticle(bool interpolated, bool quantizedLife, uint32_t blockSize, uint32_t headsPerBlock) {
+        return BYTES_PER_PARTICLE + (quantizedLife ? BYTES_PER_QUANTIZED_LIFE : BYTES_PER_LIFE)
+            + (interpolated ? BYTES_PER_INTERPOLATED : 0) + (double) BYTES_PER_HEAD * headsPerBlock / blockSize;
+    }
+    double bytesPerParticle() const { return bytesPerParticle(interpolated, quantizedLife, blockSize, headsPerBlock); }
+    size_t memoryBytes() const; // held by every array
+
+    float lifeAt(uint32_t i) const { return quantizedLife ? dequantizeLife(life16[i]) : life[i]; }
+    void setLife(uint32_t i, float value) {
+        if (quantizedLife) life16[i] = quantizeLife(value);
+        else life[i] = value;
+    }
+
+    // copy particle src's own state, but not its head slot, over particle dst
+    void move(uint32_t dst, uint32_t src);
+
+    // start particle i's interpolation at its current position, so it jumps rather than sweeps
+    void settle(uint32_t i) {
+        if (!interpolated) return;
+        prevPosX[i] = posX[i];
+        prevPosY[i] = posY[i];
+    }
+};
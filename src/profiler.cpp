@@ -0,0 +1,79 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+using namespace std;
+
+const char *profilePhaseName(int phase) {
+    static const char *names[NUM_PROFILE_PHASES] = {"events", "update", "upload", "draw", "swap", "export"};
+    return names[phase];
+}
+
+Profiler::Profiler(size_t capacity) : frames(max<size_t>(capacity, 1)) {
+    current = Frame();
+}
+
+void Profiler::beginFrame() {
+    current = Frame();
+    frameStart = Clock::now();
+}
+
+void Profiler::endFrame() {
+    current.totalMs = chrono::duration<double, milli>(Clock::now() - frameStart).count();
+    frames[next] = current;
+    next = (next + 1) % frames.size();
+    count = min(count + 1, frames.size());
+    ++totalFrames;
+}
+
+Profiler::Frame Profiler::average(size_t numFrames) const {
+    Frame mean = Frame();
+    numFrames = min(numFrames, count);
+    if (numFrames == 0) return mean;
+
+    for (size_t age = 0; age < numFrames; ++age) {
+        const Frame &f = frame(age);
+        for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) mean.phaseMs[phase] += f.phaseMs[phase];
+        mean.totalMs += f.totalMs;
+    }
+    for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) mean.phaseMs[phase] /= numFrames;
+    mean.totalMs /= numFrames;
+    return mean;
+}
+
+bool Profiler::write(const string &file) const {
+    FILE *out = fopen(file.c_str(), "w");
+    if (!out) return false;
+
+    bool json = file.size() >= 5 && file.compare(file.size() - 5, 5, ".json") == 0;
+    size_t firstFrame = totalFrames - count;
+
+    if (json) {
+        fprintf(out, "{\n  \"phases\": [");
+        for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) fprintf(out, "%s\"%s\"", phase ? ", " : "", profilePhaseName(phase));
+        fprintf(out, "],\n  \"frames\": [\n");
+    } else {
+        fprintf(out, "frame");
+        for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) fprintf(out, ",%s_ms", profilePhaseName(phase));
+        fprintf(out, ",total_ms\n");
+    }
+
+    for (size_t age = count; age-- > 0;) {
+        const Frame &f = frame(age);
+        size_t index = firstFrame + (count - 1 - age);
+        if (json) {
+            fprintf(out, "    {\"frame\": %zu", index);
+            for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) fprintf(out, ", \"%s_ms\": %.4f", profilePhaseName(phase), f.phaseMs[phase]);
+            fprintf(out, ", \"total_ms\": %.4f}%s\n", f.totalMs, age ? "," : "");
+        } else {
+            fprintf(out, "%zu", index);
+            for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) fprintf(out, ",%.4f", f.phaseMs[phase]);
+            fprintf(out, ",%.4f\n", f.totalMs);
+        }
+    }
+
+    if (json) fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return true;
+}
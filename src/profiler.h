@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+enum ProfilePhase { PHASE_EVENTS, PHASE_UPDATE, PHASE_UPLOAD, PHASE_DRAW, PHASE_SWAP, PHASE_EXPORT, NUM_PROFILE_PHASES };
+
+const char *profilePhaseName(int phase);
+
+// Per-phase CPU time of recent frames, kept in a fixed-size ring buffer.
+// GL calls are asynchronous, so GPU work shows up in whichever phase ends up
+// waiting for it, usually the buffer swap.
+struct Profiler {
+    typedef std::chrono::steady_clock Clock;
+
+    struct Frame {
+        double phaseMs[NUM_PROFILE_PHASES];
+        double totalMs; // wall time from beginFrame() to endFrame()
+    };
+
+    std::vector<Frame> frames;
+    size_t next = 0; // slot the next completed frame goes in
+    size_t count = 0; // completed frames held, at most frames.size()
+    size_t totalFrames = 0;
+    Frame current;
+    Clock::time_point frameStart;
+
+    explicit Profiler(size_t capacity = 4096);
+
+    void beginFrame();
+    void add(int phase, double ms) { current.phaseMs[phase] += ms; }
+    void endFrame();
+
+    // a completed frame, 0 being the most recent
+    const Frame &frame(size_t age) const { return frames[(next + frames.size() - 1 - age) % frames.size()]; }
+
+    // mean of the last numFrames completed frames
+    Frame average(size_t numFrames) const;
+
+    // write every held frame, oldest first; the format follows the file extension (.json, otherwise CSV)
+    bool write(const std::string &file) const;
+};
+
+// Adds the time until the end of the scope to a phase of the current frame.
+// Does nothing when profiler is null.
+struct ScopedTimer {
+    Profiler *profiler;
+    int phase;
+    Profiler::Clock::time_point start;
+
+    ScopedTimer(Profiler *profiler, int phase) : profiler(profiler), phase(phase) {
+        if (profiler) start = Profiler::Clock::now();
+    }
+
+    ~ScopedTimer() {
+        if (profiler) profiler->add(phase, std::chrono::duration<double, std::milli>(Profiler::Clock::now() - start).count());
+    }
+};
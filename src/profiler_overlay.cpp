@@ -0,0 +1,58 @@
+#include "profiler_overlay.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+
+using namespace std;
+
+const int BAR_WIDTH = 3; // pixels per frame
+const float PIXELS_PER_MS = 6.f;
+const float PHASE_COLORS[NUM_PROFILE_PHASES][3] = {
+    {0.6f, 0.6f, 0.6f}, // events
+    {0.2f, 0.8f, 0.2f}, // update
+    {0.2f, 0.5f, 1.0f}, // upload
+    {1.0f, 0.6f, 0.1f}, // draw
+    {0.8f, 0.2f, 0.8f}, // swap
+    {1.0f, 0.2f, 0.2f}, // export
+};
+
+namespace {
+
+void fillRect(int x, int y, int width, int height, float r, float g, float b, float a) {
+    if (width <= 0 || height <= 0) return;
+    glScissor(x, y, width, height);
+    glClearColor(r, g, b, a);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+}
+
+void drawProfilerOverlay(const Profiler &profiler, int screenWidth, int screenHeight, double targetMs) {
+    GLfloat clearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glEnable(GL_SCISSOR_TEST);
+
+    int numBars = min<int>((int) profiler.count, screenWidth / BAR_WIDTH);
+    int graphHeight = min<int>(screenHeight / 2, (int) (targetMs * 2 * PIXELS_PER_MS));
+    int left = screenWidth - numBars * BAR_WIDTH;
+    fillRect(left, 0, numBars * BAR_WIDTH, graphHeight, 0.f, 0.f, 0.f, 1.f);
+
+    for (int age = 0; age < numBars; ++age) {
+        const Profiler::Frame &frame = profiler.frame(age);
+        int x = screenWidth - (age + 1) * BAR_WIDTH;
+        float y = 0;
+        for (int phase = 0; phase < NUM_PROFILE_PHASES; ++phase) {
+            float height = (float) frame.phaseMs[phase] * PIXELS_PER_MS;
+            int top = min<int>((int) (y + height), graphHeight);
+            const float *c = PHASE_COLORS[phase];
+            fillRect(x, (int) y, BAR_WIDTH - 1, top - (int) y, c[0], c[1], c[2], 1.f);
+            y += height;
+        }
+    }
+
+    // frame time budget
+    fillRect(left, (int) (targetMs * PIXELS_PER_MS), numBars * BAR_WIDTH, 1, 1.f, 1.f, 1.f, 1.f);
+
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+}
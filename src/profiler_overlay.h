@@ -0,0 +1,8 @@
+#pragma once
+
+#include "profiler.h"
+
+// Draw the recent frames of a profiler as stacked per-phase bars along the
+// bottom of the screen, newest on the right, with a line at targetMs. Uses
+// scissored clears only, so it needs no shader or buffer state.
+void drawProfilerOverlay(const Profiler &profiler, int screenWidth, int screenHeight, double targetMs = 1000.0 / 60.0);
@@ -0,0 +1,25 @@
+#include "random.h"
+
+namespace {
+
+// splitmix64 finaliser, used both to combine the seed with the stream and to
+// expand the result into the generator state
+uint64_t mix64(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+}
+
+void Random::seed(uint64_t masterSeed, uint64_t stream) {
+    uint64_t x = mix64(masterSeed) ^ mix64(stream + 0x9e3779b97f4a7c15ull);
+    for (int i = 0; i < 4; i += 2) {
+        x += 0x9e3779b97f4a7c15ull;
+        uint64_t z = mix64(x);
+        state[i] = (uint32_t) z;
+        state[i + 1] = (uint32_t) (z >> 32);
+    }
+    // the all-zero state never leaves zero
+    if (!(state[0] | state[1] | state[2] | state[3])) state[0] = 1;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+
+// xoshiro128** generator. Every firework owns one, so what a firework does
+// depends only on the master seed and its index, never on which thread
+// updates it or on the order threads run in.
+struct Random {
+    uint32_t state[4] = {1, 0, 0, 0};
+
+    // seed stream `stream` of the master seed; different streams give unrelated sequences
+    void seed(uint64_t masterSeed, uint64_t stream = 0);
+
+    uint32_t next() {
+        uint32_t result = rotl(state[1] * 5, 7) * 9;
+        uint32_t t = state[1] << 9;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+        return result;
+    }
+
+    // random integer in [0, 2^31)
+    int nextInt() { return next() >> 1; }
+
+    // random float in [0, 1]
+    float nextFloat() { return (next() >> 8) * (1.0f / 16777215.0f); }
+
+private:
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+};
@@ -0,0 +1,275 @@
+#include "renderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "trace.h"
+
+using namespace std;
+
+bool Renderer::init(int screenWidth, int screenHeight, RenderMode mode) {
+    this->mode = mode;
+    this->screenWidth = screenWidth;
+    this->screenHeight = screenHeight;
+    setCamera({0.f, 0.f, (float) WORLD_WIDTH, (float) WORLD_HEIGHT});
+    view = glm::lookAt(
+            glm::vec3(0.f, 0.f, 1.f),
+            glm::vec3(0.f, 0.f, 0.f),
+            glm::vec3(0.f, 1.f, 0.f)
+            );
+
+    glEnable(GL_TEXTURE_2D);
+    bool loaded = mode == RENDER_SPRITE
+        ? program.load("./shaders/sprite_vertex.glsl", "./shaders/sprite_fragment.glsl")
+        : program.load("./shaders/vertex.glsl", "./shaders/fragment.glsl");
+    if (!loaded) return false;
+
+    // resolve everything the draw loop needs once, up front
+    mvpLocation = program.uniform("mvp");
+    paletteLocation = program.uniform("palette");
+    posAttrib = program.attribute("pos");
+    instancePosScaleAttrib = program.attribute("instancePosScale");
+    instanceAlphaAttrib = program.attribute("instanceAlpha");
+    instancePaletteAttrib = program.attribute("instancePalette");
+    if (mvpLocation < 0 || paletteLocation < 0 || posAttrib < 0 || instancePosScaleAttrib < 0
+            || instanceAlphaAttrib < 0 || instancePaletteAttrib < 0) {
+        cout << "Shader program is missing an expected uniform or attribute" << endl;
+        return false;
+    }
+
+    setupGLBuffers();
+    return true;
+}
+
+void Renderer::setCamera(const Bounds &area) {
+    camera = area;
+    projection = glm::ortho(camera.left, camera.right, camera.bottom, camera.top, -1.f, 1.f);
+}
+
+void Renderer::applyCamera(Simulation &simulation) const {
+    simulation.bounds = camera;
+    simulation.pixelsPerUnit = pixelsPerUnit();
+}
+
+void Renderer::setupGLBuffers() {
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // calculate vertices for a circle, or the corners of the quad around it
+    float vertices[(NUM_OUTER_CIRCLE_VERTICES + 1) * 3];
+
+    if (mode == RENDER_SPRITE) {
+        const float corners[] = {-1, -1, 0, 1, -1, 0, -1, 1, 0, 1, 1, 0};
+        copy(corners, corners + 12, vertices);
+        primitive = GL_TRIANGLE_STRIP;
+        numVertices = 4;
+    } else {
+        // set last vertex to center of circle
+        int len = sizeof(vertices) / sizeof(*vertices);
+        vertices[len - 1] = 0;
+        vertices[len - 2] = 0;
+        vertices[len - 3] = 0;
+
+        float theta = M_PI * 2 / (float) NUM_OUTER_CIRCLE_VERTICES;
+        float cosine = glm::cos(theta);
+        float sine = glm::sin(theta);
+
+        float x = 1;
+        float y = 0;
+
+        for (int i = 0; i < NUM_OUTER_CIRCLE_VERTICES; ++i) {
+            float temp = x;
+            x = x * cosine - y * sine;
+            y = temp * sine + y * cosine;
+
+            vertices[i * 3] = x;
+            vertices[i * 3 + 1] = y;
+            vertices[i * 3 + 2] = 0; // let z axis be 0
+        }
+        primitive = GL_TRIANGLE_FAN;
+        numVertices = NUM_OUTER_CIRCLE_VERTICES + 1;
+    }
+
+    // create vertex and color buffers
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, numVertices * 3 * sizeof(float), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(posAttrib);
+    glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+    // per-instance attributes, advanced once per circle rather than per vertex;
+    // they point into the upload ring region of each frame
+    glEnableVertexAttribArray(instancePosScaleAttrib);
+    glVertexAttribDivisor(instancePosScaleAttrib, 1);
+    glEnableVertexAttribArray(instanceAlphaAttrib);
+    glVertexAttribDivisor(instanceAlphaAttrib, 1);
+    glEnableVertexAttribArray(instancePaletteAttrib);
+    glVertexAttribDivisor(instancePaletteAttrib, 1);
+
+    // the buffer object only exists once it has been bound
+    glGenBuffers(1, &paletteBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glGenTextures(1, &paletteTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, paletteBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// pack every firework's color into the palette, one RGBA8 texel each
+void Renderer::uploadPalette(const vector<Firework> &fireworks) {
+    palette.resize(fireworks.size());
+    for (size_t i = 0; i < fireworks.size(); ++i) {
+        const Color &c = fireworks[i].color;
+        auto channel = [](float v) { return (uint32_t) (min(max(v, 0.f), 1.f) * 255.f + 0.5f); };
+        palette[i] = channel(c.r) | channel(c.g) << 8 | channel(c.b) << 16 | 255u << 24;
+    }
+
+    // orphan last frame's palette rather than wait for the GPU to finish with it
+    glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, palette.size() * sizeof(uint32_t), palette.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void Renderer::bindPalette() {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+    program.set(paletteLocation, 0);
+}
+
+void Renderer::reserveUploadRing(size_t capacity) {
+    if (capacity <= regionCapacity) return;
+
+    // the old buffer is released by GL once the frames drawing from it are done
+    if (instanceVBO) {
+        if (persistentMapping) {
+            glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+        glDeleteBuffers(1, &instanceVBO);
+    }
+    for (GLsync &fence : uploadFences) {
+        if (fence) glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    regionCapacity = capacity;
+    uploadRegion = 0;
+    GLsizeiptr size = NUM_UPLOAD_REGIONS * capacity * sizeof(ParticleInstance);
+    glGenBuffers(1, &instanceVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    persistentMapping = GLEW_ARB_buffer_storage;
+    if (persistentMapping) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+        mappedInstances = (ParticleInstance *) glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        mappedInstances = nullptr;
+    }
+}
+
+void Renderer::render(const Simulation &simulation, float interpolation) {
+    TRACE_SCOPE("render");
+    size_t offset;
+    {
+        ScopedTimer timer(profiler, PHASE_UPLOAD);
+        reserveUploadRing(max<size_t>(simulation.particles.size(), 1));
+
+        // wait for the GPU to finish drawing the frame that last used this region
+        GLsync &fence = uploadFences[uploadRegion];
+        if (fence) {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+
+        // build the visible particles' instances straight into GPU-visible memory
+        offset = uploadRegion * regionCapacity * sizeof(ParticleInstance);
+        size_t regionSize = regionCapacity * sizeof(ParticleInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        ParticleInstance *region = persistentMapping ? mappedInstances + uploadRegion * regionCapacity
+            : (ParticleInstance *) glMapBufferRange(GL_ARRAY_BUFFER, offset, regionSize,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        numDrawn = region ? buildInstances(simulation, region, interpolation, camera) : 0;
+        if (region && !persistentMapping) glUnmapBuffer(GL_ARRAY_BUFFER);
+        uploadPalette(simulation.fireworks);
+    }
+
+    ScopedTimer timer(profiler, PHASE_DRAW);
+    glClear(GL_COLOR_BUFFER_BIT);
+    program.use();
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribPointer(instancePosScaleAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void *) (offset + offsetof(ParticleInstance, x)));
+    glVertexAttribPointer(instanceAlphaAttrib, 1, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), (void *) (offset + offsetof(ParticleInstance, alpha)));
+    glVertexAttribPointer(instancePaletteAttrib, 3, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(ParticleInstance), (void *) (offset + offsetof(ParticleInstance, palette)));
+
+    // draw them all at once
+    program.set(mvpLocation, projection * view);
+    bindPalette();
+    glDrawArraysInstanced(primitive, 0, numVertices, (GLsizei) numDrawn);
+
+    uploadFences[uploadRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    uploadRegion = (uploadRegion + 1) % NUM_UPLOAD_REGIONS;
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void Renderer::setupGpuVAOs(const GpuSimulation &gpu) {
+    glGenVertexArrays(2, gpuVAOs);
+    for (int i = 0; i < 2; ++i) {
+        glBindVertexArray(gpuVAOs[i]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glEnableVertexAttribArray(posAttrib);
+        glVertexAttribPointer(posAttrib, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+
+        // the state layout starts with position, scale, life, then palette entry and alpha
+        glBindBuffer(GL_ARRAY_BUFFER, gpu.stateBuffers[i]);
+        glEnableVertexAttribArray(instancePosScaleAttrib);
+        glVertexAttribPointer(instancePosScaleAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void *) offsetof(GpuParticle, x));
+        glVertexAttribDivisor(instancePosScaleAttrib, 1);
+        glEnableVertexAttribArray(instanceAlphaAttrib);
+        glVertexAttribPointer(instanceAlphaAttrib, 1, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void *) offsetof(GpuParticle, alpha));
+        glVertexAttribDivisor(instanceAlphaAttrib, 1);
+        glEnableVertexAttribArray(instancePaletteAttrib);
+        glVertexAttribPointer(instancePaletteAttrib, 3, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void *) offsetof(GpuParticle, palette));
+        glVertexAttribDivisor(instancePaletteAttrib, 1);
+    }
+    glBindVertexArray(0);
+}
+
+void Renderer::render(const GpuSimulation &gpu) {
+    TRACE_SCOPE("render");
+    ScopedTimer timer(profiler, PHASE_DRAW);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (!gpuVAOs[0]) setupGpuVAOs(gpu);
+    uploadPalette(gpu.fireworks);
+
+    program.use();
+    glBindVertexArray(gpuVAOs[gpu.current]);
+
+    program.set(mvpLocation, projection * view);
+    bindPalette();
+    glDrawArraysInstanced(primitive, 0, numVertices, (GLsizei) gpu.capacity);
+
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glUseProgram(0);
+}
+
+void Renderer::close() {
+    program.destroy();
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &instanceVBO);
+    glDeleteTextures(1, &paletteTexture);
+    glDeleteBuffers(1, &paletteBuffer);
+    if (gpuVAOs[0]) glDeleteVertexArrays(2, gpuVAOs);
+}
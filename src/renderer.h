@@ -0,0 +1,85 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "bounds.h"
+#include "constants.h"
+#include "gpu_simulation.h"
+#include "instances.h"
+#include "profiler.h"
+#include "shader_program.h"
+#include "simulation.h"
+
+const int NUM_OUTER_CIRCLE_VERTICES = 50; // vertices along the arc of each circle in RENDER_FAN
+
+// How each particle's circle is drawn: a fan of NUM_OUTER_CIRCLE_VERTICES + 1
+// vertices, or a 4-vertex quad shaped into an antialiased circle with a soft
+// falloff in the fragment shader
+enum RenderMode { RENDER_FAN, RENDER_SPRITE };
+
+const int NUM_UPLOAD_REGIONS = 3; // frames of instance data the GPU can still be reading
+
+// Draws every live particle of a Simulation as an instanced circle
+struct Renderer {
+    RenderMode mode = RENDER_SPRITE;
+    GLenum primitive = GL_TRIANGLE_STRIP;
+    GLsizei numVertices = 0; // per particle
+    ShaderProgram program;
+    GLint mvpLocation = -1, paletteLocation = -1;
+    GLint posAttrib = -1, instancePosScaleAttrib = -1, instanceAlphaAttrib = -1, instancePaletteAttrib = -1;
+    GLuint VAO = 0, VBO = 0; // vertex array object and vertex buffer objects
+    // Instance data streams through a ring of NUM_UPLOAD_REGIONS regions, one
+    // per frame, each fenced until the GPU has drawn from it. With
+    // ARB_buffer_storage the ring stays persistently mapped; otherwise each
+    // region is mapped unsynchronized for the frame that writes it.
+    GLuint instanceVBO = 0; // per-particle position, scale, alpha and palette entry
+    size_t regionCapacity = 0; // instances per region
+    int uploadRegion = 0; // region written by the next frame
+    GLsync uploadFences[NUM_UPLOAD_REGIONS] = {};
+    bool persistentMapping = false;
+    ParticleInstance *mappedInstances = nullptr; // the whole ring while persistently mapped
+    GLuint gpuVAOs[2] = {0, 0}; // circle plus each GpuSimulation state buffer as instances
+    // Colors are stored once per firework: entry i of the palette texture
+    // buffer is the RGBA8 color of firework i, looked up by the vertex shader
+    GLuint paletteBuffer = 0, paletteTexture = 0;
+    std::vector<uint32_t> palette;
+
+    // camera variables
+    glm::mat4 projection;
+    glm::mat4 view;
+    // World-space area the camera shows. The projection maps it onto the
+    // screen, particles outside it are not drawn, and a simulation given to
+    // applyCamera retires particles that leave it for good.
+    Bounds camera;
+    int screenWidth = 0, screenHeight = 0;
+
+    size_t numDrawn = 0; // instances drawn by the last render of a Simulation
+    Profiler *profiler = nullptr; // if set, receives the upload and draw phase times
+
+    // compile the shaders and create the GL buffers; needs a current GL context
+    // the camera starts out showing the whole world
+    bool init(int screenWidth, int screenHeight, RenderMode mode = RENDER_SPRITE);
+    // point the camera at area, a finite rectangle; call applyCamera again for
+    // every simulation it draws
+    void setCamera(const Bounds &area);
+    // retire the simulation's particles against the camera and weight its
+    // trail detail by the camera's scale
+    void applyCamera(Simulation &simulation) const;
+    float pixelsPerUnit() const { return screenWidth / (camera.right - camera.left); }
+    // draw the simulation without modifying it, writing the instances straight
+    // into the upload ring; reallocates the ring only when the particle capacity grows
+    void render(const Simulation &simulation, float interpolation = 1.0f);
+
+    // draw straight from the GPU simulation's latest state buffer, dead particles included
+    void render(const GpuSimulation &gpu);
+    void close();
+
+private:
+    void setupGLBuffers();
+    void reserveUploadRing(size_t capacity);
+    void setupGpuVAOs(const GpuSimulation &gpu);
+    void uploadPalette(const std::vector<Firework> &fireworks);
+    void bindPalette();
+};
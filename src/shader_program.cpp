@@ -0,0 +1,166 @@
+#include "shader_program.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+// read a file and return its contents as a string
+string fileToString(const string& file) {
+    ifstream ifs(file);
+    stringstream ss;
+
+    while (ifs >> ss.rdbuf());
+    return ss.str();
+}
+
+void printShaderLog(GLuint shader) {
+    if (glIsShader(shader) ) {
+        int infoLogLength = 0;
+        int maxLength = infoLogLength;
+
+        glGetShaderiv( shader, GL_INFO_LOG_LENGTH, &maxLength );
+        char* infoLog = new char[ maxLength ];
+
+        glGetShaderInfoLog( shader, maxLength, &infoLogLength, infoLog );
+        if (infoLogLength > 0) {
+            printf("%s\n", &(infoLog[0]));
+        }
+
+        delete[] infoLog;
+    } else {
+        cout << to_string(shader) << " is not a shader" << endl;
+    }
+}
+
+void printProgramLog(GLuint program) {
+    int infoLogLength = 0;
+    int maxLength = 0;
+
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+    vector<char> infoLog(maxLength + 1);
+
+    glGetProgramInfoLog(program, maxLength, &infoLogLength, infoLog.data());
+    if (infoLogLength > 0) {
+        printf("%s\n", infoLog.data());
+    }
+}
+
+GLuint compileShader(GLenum type, const string &file) {
+    GLint compileSuccess;
+    GLuint shader = glCreateShader(type);
+    string source = fileToString(file);
+    const char* shaderSource = source.c_str();
+    glShaderSource(shader, 1, &shaderSource, NULL);
+    glCompileShader(shader);
+
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compileSuccess);
+    if (!compileSuccess) {
+        cout << "Failed to compile shader " << file << endl;
+        printShaderLog(shader);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+}
+
+bool ShaderProgram::load(const string &vertexFile, const string &fragmentFile) {
+    GLuint vShader = compileShader(GL_VERTEX_SHADER, vertexFile);
+    if (!vShader) return false;
+
+    GLuint fShader = compileShader(GL_FRAGMENT_SHADER, fragmentFile);
+    if (!fShader) {
+        glDeleteShader(vShader);
+        return false;
+    }
+
+    programObj = glCreateProgram();
+    glAttachShader(programObj, vShader);
+    glAttachShader(programObj, fShader);
+
+    // flag shaders for deletion on program delete
+    glDeleteShader(vShader);
+    glDeleteShader(fShader);
+    return link();
+}
+
+bool ShaderProgram::loadTransformFeedback(const string &vertexFile, const vector<const char *> &varyings) {
+    GLuint vShader = compileShader(GL_VERTEX_SHADER, vertexFile);
+    if (!vShader) return false;
+
+    programObj = glCreateProgram();
+    glAttachShader(programObj, vShader);
+    glDeleteShader(vShader);
+
+    glTransformFeedbackVaryings(programObj, (GLsizei) varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    return link();
+}
+
+bool ShaderProgram::link() {
+    glLinkProgram(programObj);
+
+    GLint linkSuccess;
+    glGetProgramiv(programObj, GL_LINK_STATUS, &linkSuccess);
+    if (!linkSuccess) {
+        cout << "Failed to link shader program" << endl;
+        printProgramLog(programObj);
+        destroy();
+        return false;
+    }
+
+    cacheLocations();
+    return true;
+}
+
+void ShaderProgram::destroy() {
+    glDeleteProgram(programObj);
+    programObj = 0;
+    uniforms.clear();
+    attributes.clear();
+}
+
+GLint ShaderProgram::uniform(const string &name) const {
+    auto it = uniforms.find(name);
+    return it == uniforms.end() ? -1 : it->second;
+}
+
+GLint ShaderProgram::attribute(const string &name) const {
+    auto it = attributes.find(name);
+    return it == attributes.end() ? -1 : it->second;
+}
+
+// record the location of every active uniform and attribute of the linked program
+void ShaderProgram::cacheLocations() {
+    GLint count, maxLength;
+    GLint size;
+    GLenum type;
+
+    glGetProgramiv(programObj, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(programObj, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    vector<char> name(maxLength + 1);
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveUniform(programObj, i, (GLsizei) name.size(), NULL, &size, &type, name.data());
+        string uniformName = name.data();
+
+        // arrays are reported as "name[0]"; make them reachable by their plain name too
+        size_t bracket = uniformName.find('[');
+        GLint location = glGetUniformLocation(programObj, uniformName.c_str());
+        uniforms[uniformName] = location;
+        if (bracket != string::npos) uniforms[uniformName.substr(0, bracket)] = location;
+    }
+
+    glGetProgramiv(programObj, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(programObj, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    name.assign(maxLength + 1, 0);
+    for (GLint i = 0; i < count; ++i) {
+        glGetActiveAttrib(programObj, i, (GLsizei) name.size(), NULL, &size, &type, name.data());
+        attributes[name.data()] = glGetAttribLocation(programObj, name.data());
+    }
+}
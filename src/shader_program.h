@@ -0,0 +1,42 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A linked GLSL program. The locations of every active uniform and attribute
+// are looked up once after linking, so nothing on the per-frame path has to
+// ask the driver for a location by name.
+struct ShaderProgram {
+    GLuint programObj = 0;
+    std::unordered_map<std::string, GLint> uniforms;
+    std::unordered_map<std::string, GLint> attributes;
+
+    // compile and link the shaders in the given files, printing any errors
+    bool load(const std::string &vertexFile, const std::string &fragmentFile);
+
+    // compile and link a vertex-only program whose outputs, in the order of
+    // varyings, are captured interleaved with transform feedback
+    bool loadTransformFeedback(const std::string &vertexFile, const std::vector<const char *> &varyings);
+    void destroy();
+
+    void use() const { glUseProgram(programObj); }
+
+    // cached location of a uniform or attribute, -1 if it is not active
+    GLint uniform(const std::string &name) const;
+    GLint attribute(const std::string &name) const;
+
+    // typed setters for the program in use
+    void set(GLint location, int value) const { glUniform1i(location, value); }
+    void set(GLint location, float value) const { glUniform1f(location, value); }
+    void set(GLint location, const glm::vec2 &value) const { glUniform2fv(location, 1, glm::value_ptr(value)); }
+    void set(GLint location, const glm::vec4 &value) const { glUniform4fv(location, 1, glm::value_ptr(value)); }
+    void set(GLint location, const glm::mat4 &value) const { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+private:
+    bool link();
+    void cacheLocations();
+};
@@ -0,0 +1,141 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "trace.h"
+
+using namespace std;
+
+// fireworks are independent, so each chunk is a run of whole fireworks
+const size_t FIREWORKS_PER_CHUNK = 16;
+
+const float FULL_TRAIL_DIAMETER = 6.f; // on-screen particle size in pixels that counts as fully important
+
+// Trail rings a firework keeps at a detail level. Its importance in [0, 1]
+// grows with the on-screen size of its particles and their remaining life,
+// and the kept fraction is detail^(2 - importance), so unimportant fireworks
+// thin out first and everything is restored at full detail.
+static int trailRings(const Firework &firework, const FireworkType &params, const ParticleSystem &ps,
+        float detail, float pixelsPerUnit) {
+    if (detail >= 1.f || params.numTrails == 0) return params.numTrails;
+    float size = min(1.f, 2.f * firework.headScale * pixelsPerUnit / FULL_TRAIL_DIAMETER);
+    float life = firework.exploded ? max(0.f, ps.lifeAt(firework.first)) : 1.f;
+    float fraction = pow(max(detail, 0.f), 2.f - size * life);
+    return max(1, (int) ceil(params.numTrails * fraction));
+}
+
+// The most detailed layout within particleBytes. Quantizing life costs less
+// than dropping interpolation, so it goes first; the compact layout with
+// quantized life is used when nothing else fits.
+static void chooseLayout(ParticleSystem &ps, size_t particleBytes, uint32_t blockSize, uint32_t maxHeads) {
+    const bool layouts[][2] = {{true, false}, {true, true}, {false, false}, {false, true}}; // interpolated, quantizedLife
+    for (auto &layout : layouts) {
+        ps.interpolated = layout[0];
+        ps.quantizedLife = layout[1];
+        if (particleBytes == 0 || particleBytes >= ParticleSystem::bytesPerParticle(layout[0], layout[1], blockSize, maxHeads)) return;
+    }
+}
+
+bool Simulation::init(const FireworkConfig &config, int numThreads, size_t particleCapacity, uint64_t seed,
+        size_t particleBytes) {
+    uint64_t blockSize = config.blockSize();
+    uint64_t numBlocks = particleCapacity ? particleCapacity / blockSize : max(config.numFireworks, 0);
+    uint64_t numParticles = config.numParticles(numBlocks);
+    if (numParticles > FireworkConfig::MAX_PARTICLES) {
+        cout << "Too many particles (" << numParticles << ", limit " << FireworkConfig::MAX_PARTICLES << ")" << endl;
+        return false;
+    }
+
+    if (!threads || (numThreads > 0 && threads->numThreads() != numThreads)) threads.reset(new ThreadPool(numThreads));
+
+    this->config = config;
+    int numFireworks = config.numFireworks;
+    uint32_t maxHeads = config.maxHeads();
+    particles.headsPerBlock = maxHeads;
+    chooseLayout(particles, particleBytes, (uint32_t) blockSize, maxHeads);
+    pool.init(particles, numBlocks, (uint32_t) blockSize);
+    fireworks.assign(numFireworks, Firework());
+
+    // size the retirement scratch for the largest explosion so updates never allocate
+    for (int i = 0; i < numFireworks; ++i) {
+        fireworks[i].rng.seed(seed, i);
+        fireworks[i].keptHeads.reserve(maxHeads);
+    }
+    launchFireworks();
+    return true;
+}
+
+// update all fireworks in the world
+void Simulation::update(float dt) {
+    TRACE_SCOPE("update");
+    threads->parallelFor(fireworks.size(), FIREWORKS_PER_CHUNK, [&](size_t begin, size_t end) {
+        TRACE_SCOPE("update chunk");
+        for (size_t i = begin; i < end; ++i) {
+            Firework &firework = fireworks[i];
+            const FireworkType &params = config.types[firework.type];
+            if (firework.launched) {
+                firework.setTrailRings(trailRings(firework, params, particles, trailDetail, pixelsPerUnit), particles, params);
+            }
+            firework.update(dt, particles, params, bounds);
+        }
+    });
+
+    launchFireworks();
+}
+
+void Simulation::stagger(float seconds, float dt) {
+    TRACE_SCOPE("stagger");
+    int totalSteps = (int) (seconds / dt);
+    threads->parallelFor(fireworks.size(), FIREWORKS_PER_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Firework &firework = fireworks[i];
+            int steps = (int) (i * totalSteps / fireworks.size());
+            for (int step = 0; step < steps; ++step) firework.update(dt, particles, config.types[firework.type], bounds);
+        }
+    });
+    launchFireworks();
+}
+
+// runs on the calling thread in firework order, so blocks are handed out the
+// same way whatever the number of threads
+void Simulation::launchFireworks() {
+    TRACE_SCOPE("launch");
+    int launched = numLaunched();
+    for (auto &firework : fireworks) {
+        if (firework.launched) continue;
+
+        if (firework.first != ParticlePool::NO_BLOCK) {
+            pool.release(firework.first);
+            firework.first = ParticlePool::NO_BLOCK;
+            if (launched >= maxLaunched) ++numHeldLaunches;
+        }
+        if (launched >= maxLaunched) continue;
+
+        firework.first = pool.acquire();
+        if (firework.first == ParticlePool::NO_BLOCK) continue;
+
+        firework.type = config.pickType(firework.rng);
+        firework.reset(particles, config.types[firework.type]);
+        ++launched;
+    }
+}
+
+int Simulation::numLaunched() const {
+    int count = 0;
+    for (auto &firework : fireworks) count += firework.launched;
+    return count;
+}
+
+size_t Simulation::numLiveParticles() const {
+    size_t count = 0;
+    for (auto &firework : fireworks) count += firework.numLive();
+    return count;
+}
+
+size_t Simulation::memoryBytes() const {
+    size_t bytes = particles.memoryBytes() + pool.freeBlocks.capacity() * sizeof(uint32_t) + fireworks.capacity() * sizeof(Firework);
+    for (auto &firework : fireworks) bytes += firework.keptHeads.capacity() * sizeof(uint32_t);
+    return bytes;
+}
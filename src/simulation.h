@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "bounds.h"
+#include "constants.h"
+#include "firework.h"
+#include "firework_config.h"
+#include "particle_pool.h"
+#include "particle_system.h"
+#include "thread_pool.h"
+
+// All fireworks in the world and the particle storage they share
+struct Simulation {
+    FireworkConfig config;
+    ParticleSystem particles;
+    ParticlePool pool;
+    std::vector<Firework> fireworks;
+    std::unique_ptr<ThreadPool> threads;
+    // explosion particles that leave this area and cannot return are retired
+    // early; an unbounded rectangle keeps them until they burn out. A viewer
+    // sets it to what its camera shows with Renderer::applyCamera.
+    Bounds bounds = {0.f, 0.f, (float) WORLD_WIDTH, (float) WORLD_HEIGHT};
+    // Fraction of trail rings kept, usually set by a TrailLod. Below 1,
+    // fireworks that are small on screen or close to burning out lose their
+    // rings first; 1 keeps every ring.
+    float trailDetail = 1.f;
+    float pixelsPerUnit = 1.f; // on-screen size of a world unit, set with bounds by Renderer::applyCamera
+    // Fireworks allowed in flight at once, usually set by a LaunchGovernor.
+    // The rest wait on the ground with no particle block until others burn out.
+    int maxLaunched = INT_MAX;
+    size_t numHeldLaunches = 0; // fireworks that burnt out and were kept on the ground by maxLaunched
+
+    // create config.numFireworks fireworks and a pool of numThreads threads to
+    // update them (0 uses every hardware thread). The particle pool holds
+    // particleCapacity particles, rounded down to whole firework blocks sized
+    // for the largest type; 0 gives every firework a block. Fireworks wait on
+    // the ground while no block is free. Firework i draws from stream i of
+    // seed, so a seed gives the same run whatever the number of threads.
+    // particleBytes is the mean storage each particle may take
+    // (ParticleSystem::bytesPerParticle): when the full layout does not fit,
+    // life is first quantized to 16 bits, then the previous positions are
+    // dropped and rendering no longer interpolates between steps; 0 is
+    // unlimited. Returns false, leaving the simulation
+    // as it was, if the blocks would need more than
+    // FireworkConfig::MAX_PARTICLES particles.
+    bool init(const FireworkConfig &config, int numThreads = 0, size_t particleCapacity = 0, uint64_t seed = 1,
+            size_t particleBytes = 0);
+    // the smallest particleBytes a config fits in
+    static double minParticleBytes(const FireworkConfig &config) {
+        return ParticleSystem::bytesPerParticle(false, true, (uint32_t) config.blockSize(), config.maxHeads());
+    }
+    void update(float dt);
+
+    // Advance firework i of n on its own by i / n of `seconds` in steps of dt,
+    // so fireworks that launched together do not burn out in lockstep. Meant
+    // to be called right after init().
+    void stagger(float seconds, float dt);
+    size_t numLiveParticles() const;
+    size_t memoryBytes() const; // particle storage, pool and fireworks
+    int numLaunched() const;
+
+private:
+    // return the blocks of burnt out fireworks to the pool and relaunch them
+    void launchFireworks();
+};
@@ -0,0 +1,133 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#include "trace.h"
+
+using namespace std;
+
+namespace {
+
+uint64_t packRange(uint32_t front, uint32_t back) {
+    return (uint64_t) front << 32 | back;
+}
+
+}
+
+ThreadPool::ThreadPool(int numThreads) {
+    if (numThreads <= 0) numThreads = max(1u, thread::hardware_concurrency());
+
+    threadCount = numThreads;
+    deques.reset(new Deque[numThreads]);
+    for (int i = 1; i < numThreads; ++i) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) worker.join();
+}
+
+void ThreadPool::run(size_t count, size_t chunkSize, ChunkFn fn, void *ctx) {
+    if (count == 0) return;
+    chunkSize = max<size_t>(chunkSize, 1);
+    uint32_t numChunks = (uint32_t) ((count + chunkSize - 1) / chunkSize);
+
+    // nothing to share, skip waking the workers
+    if (workers.empty() || numChunks == 1) {
+        for (size_t begin = 0; begin < count; begin += chunkSize) fn(ctx, begin, min(begin + chunkSize, count));
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stateMutex);
+        jobFn = fn;
+        jobCtx = ctx;
+        jobCount = count;
+        jobChunkSize = chunkSize;
+        remainingChunks = numChunks;
+        busyWorkers = (int) workers.size();
+
+        // deal out contiguous runs of chunks so each thread starts on its own data
+        int numDeques = numThreads();
+        for (int i = 0; i < numDeques; ++i) {
+            uint32_t front = (uint64_t) numChunks * i / numDeques;
+            uint32_t back = (uint64_t) numChunks * (i + 1) / numDeques;
+            deques[i].range.store(packRange(front, back), memory_order_relaxed);
+        }
+        ++generation;
+    }
+    wake.notify_all();
+
+    runChunks(0);
+
+    unique_lock<mutex> lock(stateMutex);
+    done.wait(lock, [this] { return remainingChunks.load() == 0 && busyWorkers.load() == 0; });
+}
+
+void ThreadPool::workerLoop(int index) {
+    setTraceThreadName("worker", index);
+    uint64_t seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(stateMutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+
+        runChunks(index);
+
+        if (--busyWorkers == 0) {
+            lock_guard<mutex> lock(stateMutex);
+            done.notify_all();
+        }
+    }
+}
+
+// run chunks from this thread's deque, then steal until no work is left anywhere
+void ThreadPool::runChunks(int index) {
+    uint32_t chunk;
+    while (popFront(index, chunk) || stealBack(index, chunk)) {
+        size_t begin = chunk * jobChunkSize;
+        jobFn(jobCtx, begin, min(begin + jobChunkSize, jobCount));
+
+        if (--remainingChunks == 0) {
+            lock_guard<mutex> lock(stateMutex);
+            done.notify_all();
+        }
+    }
+}
+
+bool ThreadPool::popFront(int index, uint32_t &chunk) {
+    atomic<uint64_t> &range = deques[index].range;
+    uint64_t value = range.load(memory_order_acquire);
+    while (true) {
+        uint32_t front = value >> 32, back = (uint32_t) value;
+        if (front >= back) return false;
+        if (range.compare_exchange_weak(value, packRange(front + 1, back), memory_order_acq_rel)) {
+            chunk = front;
+            return true;
+        }
+    }
+}
+
+bool ThreadPool::stealBack(int index, uint32_t &chunk) {
+    int numDeques = numThreads();
+    for (int offset = 1; offset < numDeques; ++offset) {
+        atomic<uint64_t> &range = deques[(index + offset) % numDeques].range;
+        uint64_t value = range.load(memory_order_acquire);
+        while (true) {
+            uint32_t front = value >> 32, back = (uint32_t) value;
+            if (front >= back) break;
+            if (range.compare_exchange_weak(value, packRange(front, back - 1), memory_order_acq_rel)) {
+                chunk = back - 1;
+                return true;
+            }
+        }
+    }
+    return false;
+}
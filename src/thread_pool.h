@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent pool of worker threads for data-parallel loops.
+//
+// parallelFor() splits [0, count) into chunks and deals contiguous runs of
+// chunks onto one deque per thread. Each thread pops chunks from the front of
+// its own deque and, once that is empty, steals from the back of the others.
+// The calling thread takes part in the work and the call returns once every
+// chunk has run. No memory is allocated per call.
+class ThreadPool {
+public:
+    // numThreads counts the calling thread; 0 uses every hardware thread
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    int numThreads() const { return threadCount; }
+
+    // call fn(begin, end) for chunks of at most chunkSize items covering [0, count)
+    template <class F>
+    void parallelFor(size_t count, size_t chunkSize, F &&fn) {
+        auto call = [](void *ctx, size_t begin, size_t end) { (*static_cast<F *>(ctx))(begin, end); };
+        run(count, chunkSize, call, &fn);
+    }
+
+private:
+    typedef void (*ChunkFn)(void *, size_t, size_t);
+
+    // range of chunk indices packed as (front << 32 | back) so that the owner
+    // and thieves can both claim a chunk with a single compare-and-swap
+    struct alignas(64) Deque {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void run(size_t count, size_t chunkSize, ChunkFn fn, void *ctx);
+    void workerLoop(int index);
+    void runChunks(int index);
+    bool popFront(int index, uint32_t &chunk);
+    bool stealBack(int index, uint32_t &chunk);
+
+    int threadCount;
+    std::unique_ptr<Deque[]> deques; // one per thread, 0 belongs to the caller
+    std::vector<std::thread> workers;
+
+    // current job
+    ChunkFn jobFn = nullptr;
+    void *jobCtx = nullptr;
+    size_t jobCount = 0;
+    size_t jobChunkSize = 1;
+    std::atomic<uint32_t> remainingChunks{0};
+    std::atomic<int> busyWorkers{0};
+
+    std::mutex stateMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
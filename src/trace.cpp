@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+atomic<bool> traceEnabled(false);
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+const size_t EVENTS_PER_THREAD = 1 << 17; // later events on a full buffer are dropped and counted
+
+struct TraceEvent {
+    const char *name;
+    int64_t start, end;
+};
+
+struct TraceBuffer {
+    unique_ptr<TraceEvent[]> events;
+    atomic<size_t> count{0}; // only the owning thread writes it
+    size_t dropped = 0;
+    int tid;
+    const char *threadName;
+    int threadIndex;
+};
+
+mutex registryMutex; // guards buffers; taken once per thread, on its first event
+vector<unique_ptr<TraceBuffer>> buffers;
+Clock::time_point origin = Clock::now();
+
+thread_local TraceBuffer *threadBuffer = nullptr;
+thread_local const char *threadName = nullptr;
+thread_local int threadIndex = -1;
+
+TraceBuffer *registerThread() {
+    unique_ptr<TraceBuffer> buffer(new TraceBuffer());
+    buffer->events.reset(new TraceEvent[EVENTS_PER_THREAD]);
+    buffer->threadName = threadName;
+    buffer->threadIndex = threadIndex;
+
+    lock_guard<mutex> lock(registryMutex);
+    buffer->tid = (int) buffers.size() + 1;
+    buffers.push_back(move(buffer));
+    return buffers.back().get();
+}
+
+}
+
+void startTracing() {
+    origin = Clock::now();
+    traceEnabled.store(true);
+}
+
+void setTraceThreadName(const char *name, int index) {
+    threadName = name;
+    threadIndex = index;
+    if (threadBuffer) {
+        threadBuffer->threadName = name;
+        threadBuffer->threadIndex = index;
+    }
+}
+
+int64_t traceNow() {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - origin).count();
+}
+
+void traceEvent(const char *name, int64_t start, int64_t end) {
+    TraceBuffer *buffer = threadBuffer;
+    if (!buffer) buffer = threadBuffer = registerThread();
+
+    size_t count = buffer->count.load(memory_order_relaxed);
+    if (count == EVENTS_PER_THREAD) {
+        ++buffer->dropped;
+        return;
+    }
+    buffer->events[count] = {name, start, end};
+    buffer->count.store(count + 1, memory_order_release);
+}
+
+bool writeTrace(const string &file) {
+    traceEnabled.store(false);
+
+    FILE *out = fopen(file.c_str(), "w");
+    if (!out) return false;
+
+    lock_guard<mutex> lock(registryMutex);
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool first = true;
+    size_t dropped = 0;
+    for (auto &buffer : buffers) {
+        if (buffer->threadName) {
+            fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s",
+                    first ? "" : ",\n", buffer->tid, buffer->threadName);
+            if (buffer->threadIndex >= 0) fprintf(out, " %d", buffer->threadIndex);
+            fprintf(out, "\"}}");
+            first = false;
+        }
+
+        size_t count = buffer->count.load(memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            const TraceEvent &e = buffer->events[i];
+            fprintf(out, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                    first ? "" : ",\n", e.name, buffer->tid, e.start / 1000.0, (e.end - e.start) / 1000.0);
+            first = false;
+        }
+        dropped += buffer->dropped;
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+
+    if (dropped) fprintf(stderr, "trace: dropped %zu events from full buffers\n", dropped);
+    return true;
+}
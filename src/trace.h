@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Chrome trace-event recording (chrome://tracing, Perfetto). Each thread
+// appends complete events to its own fixed-size buffer without locking;
+// the buffers are only read by writeTrace() once the traced work is done.
+// While tracing is off a TRACE_SCOPE costs one relaxed atomic load.
+
+extern std::atomic<bool> traceEnabled;
+
+void startTracing();
+// stop recording and write every buffered event as trace JSON; call once no traced work is running
+bool writeTrace(const std::string &file);
+
+// label this thread's track in the trace, e.g. ("worker", 2); the name must outlive the trace
+void setTraceThreadName(const char *name, int index = -1);
+
+int64_t traceNow(); // nanoseconds since startTracing()
+void traceEvent(const char *name, int64_t start, int64_t end);
+
+// Records the lifetime of the scope as one event, if tracing was on when it began
+struct TraceScope {
+    const char *name;
+    int64_t start = -1;
+
+    explicit TraceScope(const char *name) : name(name) {
+        if (traceEnabled.load(std::memory_order_relaxed)) start = traceNow();
+    }
+
+    ~TraceScope() {
+        if (start >= 0) traceEvent(name, start, traceNow());
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
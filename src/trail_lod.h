@@ -0,0 +1,29 @@
+#pragma once
+
+#include <algorithm>
+
+// Picks the trail detail (1 = every trail ring, down to MIN_DETAIL) that keeps
+// frame time within a budget. Detail backs off a little every frame the
+// smoothed frame time is over budget and creeps back while there is headroom,
+// so it settles just under the budget on whatever machine it runs on.
+struct TrailLod {
+    static constexpr float MIN_DETAIL = 0.1f;
+    static constexpr float SMOOTHING = 0.1f; // weight of the newest frame in the smoothed frame time
+    static constexpr float BACK_OFF = 0.95f; // detail kept per frame over budget
+    static constexpr float RECOVERY = 0.01f; // detail regained per frame with headroom
+    static constexpr float HEADROOM = 0.85f; // fraction of the budget below which detail recovers
+
+    double budgetMs; // 0 disables the controller and keeps full detail
+    double smoothedMs = 0;
+    float detail = 1.f;
+
+    explicit TrailLod(double budgetMs = 0) : budgetMs(budgetMs) {}
+
+    // feed the time a frame took, excluding any wait for the display
+    void update(double frameMs) {
+        if (budgetMs <= 0) return;
+        smoothedMs = smoothedMs > 0 ? smoothedMs + (frameMs - smoothedMs) * SMOOTHING : frameMs;
+        if (smoothedMs > budgetMs) detail = std::max(MIN_DETAIL, detail * BACK_OFF);
+        else if (smoothedMs < budgetMs * HEADROOM) detail = std::min(1.f, detail + RECOVERY);
+    }
+};
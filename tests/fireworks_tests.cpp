@@ -0,0 +1,413 @@
+// Unit tests for the simulation library, run by ctest. Each test function
+// covers one part of the library and prints the checks that fail; the
+// process exits non-zero if any did.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "firework_config.h"
+#include "fixed_timestep.h"
+#include "instances.h"
+#include "integrate.h"
+#include "launch_governor.h"
+#include "particle_pool.h"
+#include "simulation.h"
+#include "trail_lod.h"
+
+using namespace std;
+
+int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+const float DT = 1.0f / 60.0f;
+
+// every drag and fade policy, so every kernel instantiation runs
+FireworkConfig kernelConfig(int numFireworks) {
+    FireworkConfig config;
+    config.numFireworks = numFireworks;
+    config.types.clear();
+    config.names.clear();
+    for (int drag = 0; drag < NUM_DRAG_MODELS; ++drag) {
+        for (int fade = 0; fade < NUM_FADE_MODES; ++fade) {
+            FireworkType type;
+            type.drag = (DragModel) drag;
+            type.fade = (FadeMode) fade;
+            type.minParticles = 13; // odd counts leave a scalar tail after every vector loop
+            type.maxParticles = 41;
+            type.numTrails = 5;
+            config.types.push_back(type);
+            config.names.push_back("type" + to_string(config.types.size()));
+        }
+    }
+    return config;
+}
+
+// FNV-1a over the live particles of every firework in firework order. Unlike
+// the bench's hash this also covers life and head velocities, so a kernel or
+// layout that only diverges in those is caught before it shows on screen
+uint64_t stateHash(const Simulation &simulation) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto add = [&](const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    };
+
+    const ParticleSystem &ps = simulation.particles;
+    for (const Firework &firework : simulation.fireworks) {
+        if (firework.first == ParticlePool::NO_BLOCK) continue;
+        size_t count = firework.numLive();
+        add(&ps.posX[firework.first], count * sizeof(float));
+        add(&ps.posY[firework.first], count * sizeof(float));
+        if (ps.quantizedLife) add(&ps.life16[firework.first], count * sizeof(uint16_t));
+        else add(&ps.life[firework.first], count * sizeof(float));
+        add(&ps.alpha[firework.first], count * sizeof(uint8_t));
+        uint32_t heads = ps.heads(firework.first);
+        add(&ps.velX[heads], firework.numHeads * sizeof(float));
+        add(&ps.velY[heads], firework.numHeads * sizeof(float));
+    }
+    return hash;
+}
+
+uint64_t run(const FireworkConfig &config, int numThreads, int frames, size_t particleBytes = 0) {
+    Simulation simulation;
+    simulation.init(config, numThreads, 0, 7, particleBytes);
+    for (int frame = 0; frame < frames; ++frame) simulation.update(DT);
+    return stateHash(simulation);
+}
+
+// with float life, and with the 16-bit life of the smallest layout
+void testKernelsMatch() {
+    FireworkConfig config = kernelConfig(60);
+    IntegrateKernel best = bestIntegrateKernel();
+    for (size_t particleBytes : {(size_t) 0, (size_t) Simulation::minParticleBytes(config) + 1}) {
+        setIntegrateKernel(KERNEL_SCALAR);
+        uint64_t expected = run(config, 1, 400, particleBytes);
+        for (int kernel = KERNEL_SSE2; kernel <= best; ++kernel) {
+            setIntegrateKernel((IntegrateKernel) kernel);
+            uint64_t hash = run(config, 1, 400, particleBytes);
+            if (hash != expected) {
+                fprintf(stderr, "%s kernel differs from scalar with a budget of %zu bytes\n",
+                        integrateKernelName((IntegrateKernel) kernel), particleBytes);
+            }
+            CHECK(hash == expected);
+        }
+    }
+    setIntegrateKernel(best);
+}
+
+// each budget gets the most detailed layout that fits in it
+void testParticleBudget() {
+    FireworkConfig config = kernelConfig(4);
+    uint32_t blockSize = (uint32_t) config.blockSize();
+    uint32_t heads = config.maxHeads();
+    Simulation simulation;
+    struct { bool interpolated, quantizedLife; } layouts[] = {{true, false}, {true, true}, {false, false}, {false, true}};
+    for (auto &layout : layouts) {
+        double bytes = ParticleSystem::bytesPerParticle(layout.interpolated, layout.quantizedLife, blockSize, heads);
+        CHECK(simulation.init(config, 1, 0, 7, (size_t) ceil(bytes)));
+        CHECK(simulation.particles.interpolated == layout.interpolated);
+        CHECK(simulation.particles.quantizedLife == layout.quantizedLife);
+        CHECK(simulation.particles.bytesPerParticle() <= ceil(bytes));
+    }
+    CHECK(simulation.particles.life.empty() && simulation.particles.life16.size() == simulation.particles.size());
+    CHECK(simulation.init(config, 1, 0, 7, 0));
+    CHECK(simulation.particles.interpolated && !simulation.particles.quantizedLife);
+
+    // 16-bit life keeps 1 exact, stores run out life as 0 and rounds to the nearest step
+    CHECK(dequantizeLife(quantizeLife(1.f)) == 1.f);
+    CHECK(quantizeLife(-0.25f) == 0 && quantizeLife(0.f) == 0);
+    for (float life : {0.1f, 0.5f, 0.73f}) CHECK(fabs(dequantizeLife(quantizeLife(life)) - life) <= 0.5f / LIFE_STEPS);
+}
+
+void testThreadCountsMatch() {
+    FireworkConfig config = kernelConfig(100);
+    uint64_t expected = run(config, 1, 300);
+    for (int threads : {2, 3, 8}) CHECK(run(config, threads, 300) == expected);
+}
+
+// An exploded firework with three heads and two trail rings at the left edge
+// of a 100 x 100 view: head 0 is past it and moving away, head 1 is past it
+// but coming back, and head 2 is in view. Every particle's decay rate tags its
+// place in the block.
+void testRetirement() {
+    const uint32_t NUM_HEADS = 3, NUM_TRAILS = 2;
+    const float DECAY_TAG = 1e-3f; // slow enough that no trail particle respawns
+    FireworkType params;
+    params.drag = DRAG_NONE;
+    params.numTrails = NUM_TRAILS;
+    ParticleSystem ps;
+    ps.headsPerBlock = NUM_HEADS;
+    ps.resize(1, NUM_HEADS * (1 + NUM_TRAILS));
+
+    Firework firework;
+    firework.first = 0;
+    firework.launched = firework.exploded = true;
+    firework.numHeads = NUM_HEADS;
+    firework.numTrails = NUM_TRAILS;
+    firework.keptHeads.reserve(NUM_HEADS);
+    const float headX[] = {-50.f, -50.f, 50.f}, origVelX[] = {-10.f, 10.f, 20.f};
+    for (uint32_t i = 0; i < firework.numLive(); ++i) {
+        uint32_t head = i % NUM_HEADS;
+        ps.posX[i] = headX[head];
+        ps.posY[i] = 50.f;
+        ps.settle(i);
+        ps.setLife(i, 1.f);
+        ps.decayRate[i] = DECAY_TAG * (i + 1);
+    }
+    for (uint32_t h = 0; h < NUM_HEADS; ++h) {
+        ps.velX[h] = ps.origVelX[h] = origVelX[h];
+        ps.velY[h] = ps.origVelY[h] = 0.f;
+        ps.scale[h] = 1.f;
+    }
+
+    Bounds view = {0.f, 0.f, 100.f, 100.f};
+    firework.update(DT, ps, params, view);
+
+    // head 0 and both of its trail particles are gone; the rest keep their ring layout
+    CHECK(firework.numHeads == 2);
+    CHECK(firework.numLive() == 2 * (1 + NUM_TRAILS));
+    for (uint32_t segment = 0; segment <= NUM_TRAILS; ++segment) {
+        for (uint32_t k = 0; k < 2; ++k) {
+            uint32_t i = segment * 2 + k;
+            uint32_t before = segment * NUM_HEADS + k + 1;
+            CHECK(ps.decayRate[i] == DECAY_TAG * (before + 1));
+            CHECK(fabs(ps.posX[i] - headX[k + 1]) < 1.f);
+        }
+    }
+    for (uint32_t k = 0; k < 2; ++k) {
+        CHECK(ps.origVelX[k] == origVelX[k + 1]);
+        CHECK(ps.velX[k] == origVelX[k + 1] * DT);
+        CHECK(ps.posX[k] == headX[k + 1] + origVelX[k + 1] * DT);
+        CHECK(ps.prevPosX[k] == headX[k + 1]);
+    }
+
+    // a head past the right edge is kept while its trail is still in view, and retired with it once it is not
+    for (int step = 0; step < 10 * 60; ++step) firework.update(DT, ps, params, view);
+    CHECK(ps.posX[1] > 200.f);
+    CHECK(firework.numHeads == 2);
+    for (uint32_t i = 1 + 2; i < firework.numLive(); i += 2) {
+        ps.posX[i] = 300.f;
+        ps.settle(i);
+    }
+    firework.update(DT, ps, params, view);
+    CHECK(firework.numHeads == 1);
+    CHECK(ps.origVelX[0] == origVelX[1]);
+}
+
+// only particles that overlap the view are emitted, at their blended positions
+void testInstanceCulling() {
+    FireworkConfig config;
+    config.numFireworks = 1;
+    config.types[0].numTrails = 3;
+    Simulation simulation;
+    CHECK(simulation.init(config, 1));
+    ParticleSystem &ps = simulation.particles;
+    const Firework &firework = simulation.fireworks[0];
+    CHECK(firework.numLive() == 4);
+
+    // the rocket and trail particles in view, just past the right edge, touching it, and below the view
+    const float x[] = {50.f, 102.f, 100.5f, 50.f}, y[] = {50.f, 50.f, 50.f, -2.f};
+    for (uint32_t p = 0; p < 4; ++p) {
+        ps.posX[firework.first + p] = x[p];
+        ps.posY[firework.first + p] = y[p];
+        ps.settle(firework.first + p);
+    }
+    ps.scale[ps.heads(firework.first)] = 1.f;
+
+    vector<ParticleInstance> instances(ps.size());
+    Bounds view = {0.f, 0.f, 100.f, 100.f};
+    CHECK(buildInstances(simulation, instances.data(), 1.f, view) == 2);
+    CHECK(instances[0].x == 50.f && instances[0].y == 50.f);
+    CHECK(instances[1].x == 100.5f && instances[1].scale == TRAIL_SCALE);
+    CHECK(buildInstances(simulation, instances.data(), 1.f) == 4);
+
+    // an interpolated particle is culled where it is drawn, not where it ends up
+    ps.prevPosX[firework.first + 1] = 90.f;
+    CHECK(buildInstances(simulation, instances.data(), 0.f, view) == 3);
+}
+
+// load text as a config file into config
+bool loadText(FireworkConfig &config, const string &text) {
+    const char *file = "fireworks_tests.ini";
+    ofstream(file) << text;
+    bool loaded = config.load(file);
+    remove(file);
+    return loaded;
+}
+
+void testConfigErrors() {
+    FireworkConfig config;
+    CHECK(!config.load("no/such/config.ini"));
+    CHECK(!loadText(config, "[peony]\ngravity = 10\n")); // rockets would never explode
+    CHECK(!loadText(config, "[peony]\ngravity = 0\n"));
+    CHECK(!loadText(config, "[peony]\nsparkle = 1\n"));
+    CHECK(!loadText(config, "[show]\nrockets = 4\n"));
+    CHECK(!loadText(config, "[peony\n"));
+    CHECK(!loadText(config, "[peony]\nparticles\n"));
+    CHECK(!loadText(config, "[peony]\nparticles = 10 20 30\n"));
+    CHECK(!loadText(config, "[peony]\ndrag = sticky\n"));
+    CHECK(!loadText(config, "[a]\nweight = 0\n[b]\nweight = 0\n"));
+    CHECK(!loadText(config, "fireworks = -1\n"));
+    CHECK(!loadText(config, "[huge]\nparticles = 65536\ntrails = 65536\n")); // 2^32 + 2^16 particles in one block
+    CHECK(!loadText(config, "fireworks = 70000\n[big]\nparticles = 65536\n"));
+
+    // a failed load leaves the config as it was, even past the keys that parsed
+    config = FireworkConfig();
+    CHECK(!loadText(config, "fireworks = 99\n[peony]\nparticles = 5\n[willow]\ntrails = many\n"));
+    CHECK(config.numFireworks == 10);
+    CHECK(config.types.size() == 1 && config.types[0].minParticles == 30);
+    CHECK(config.names.size() == 1 && config.names[0] == "default");
+
+    CHECK(loadText(config, "fireworks = 99 ; comment\n[peony]\nparticles = 5\ngravity = -100\n[willow]\ntrails = 3\n"));
+    CHECK(config.numFireworks == 99);
+    CHECK(config.types.size() == 2 && config.names[1] == "willow");
+    CHECK(config.types[0].minParticles == 5 && config.types[0].maxParticles == 5);
+    CHECK(config.types[0].gravity == -100.f);
+    CHECK(config.types[1].numTrails == 3);
+}
+
+// a config built in code is checked again when the simulation is sized
+void testSimulationRejectsOverflow() {
+    FireworkConfig config;
+    config.types[0].minParticles = config.types[0].maxParticles = 65536;
+    config.types[0].numTrails = 65536;
+    Simulation simulation;
+    CHECK(!simulation.init(config, 1));
+    CHECK(simulation.particles.size() == 0);
+
+    config.types[0].numTrails = 0;
+    config.numFireworks = 70000;
+    CHECK(!simulation.init(config, 1));
+    config.numFireworks = 10;
+    CHECK(simulation.init(config, 1));
+    CHECK(simulation.particles.size() == 10 * 65536);
+}
+
+void testPoolFreeList() {
+    ParticleSystem ps;
+    ParticlePool pool;
+    pool.init(ps, 3, 10);
+    CHECK(ps.size() == 30);
+    CHECK(pool.numBlocks() == 3 && pool.numFree() == 3);
+
+    vector<uint32_t> blocks;
+    for (int i = 0; i < 3; ++i) blocks.push_back(pool.acquire());
+    CHECK(pool.acquire() == ParticlePool::NO_BLOCK);
+    CHECK(pool.numFree() == 0);
+    for (uint32_t first : blocks) CHECK(first % 10 == 0 && first < 30);
+    CHECK(blocks[0] != blocks[1] && blocks[1] != blocks[2] && blocks[0] != blocks[2]);
+
+    // a released block is handed out again, and the free list never grows
+    const uint32_t *storage = pool.freeBlocks.data();
+    pool.release(blocks[1]);
+    CHECK(pool.numFree() == 1);
+    CHECK(pool.acquire() == blocks[1]);
+    for (uint32_t first : blocks) pool.release(first);
+    CHECK(pool.numFree() == 3 && pool.numBlocks() == 3);
+    CHECK(pool.freeBlocks.data() == storage);
+}
+
+void testFixedTimestepClamps() {
+    FixedTimestep timestep(60.0, 5);
+    CHECK(timestep.advance(0.5 / 60.0) == 0);
+    CHECK(fabs(timestep.interpolation() - 0.5f) < 1e-4f);
+    CHECK(timestep.advance(1.0 / 60.0) == 1);
+    CHECK(fabs(timestep.interpolation() - 0.5f) < 1e-4f);
+
+    // a hitch runs maxSteps and drops the rest of the backlog
+    CHECK(timestep.advance(2.0) == 5);
+    CHECK(timestep.interpolation() < 1e-4f);
+    CHECK(timestep.advance(1.0 / 60.0) == 1);
+
+    FixedTimestep atLeastOne(60.0, 0);
+    CHECK(atLeastOne.maxSteps == 1);
+    CHECK(atLeastOne.advance(1.0) == 1);
+}
+
+void testTrailLod() {
+    TrailLod disabled;
+    for (int frame = 0; frame < 100; ++frame) disabled.update(1000.0);
+    CHECK(disabled.detail == 1.f);
+
+    // over budget detail backs off every frame, but never below MIN_DETAIL
+    TrailLod lod(10.0);
+    lod.update(20.0);
+    CHECK(lod.detail == TrailLod::BACK_OFF);
+    float previous = lod.detail;
+    lod.update(20.0);
+    CHECK(lod.detail < previous);
+    for (int frame = 0; frame < 1000; ++frame) lod.update(20.0);
+    CHECK(lod.detail == TrailLod::MIN_DETAIL);
+
+    // just under budget but above HEADROOM it holds, below HEADROOM it recovers fully
+    for (int frame = 0; frame < 1000; ++frame) lod.update(9.0);
+    CHECK(lod.smoothedMs < 10.0 && lod.smoothedMs > 10.0 * TrailLod::HEADROOM);
+    CHECK(lod.detail == TrailLod::MIN_DETAIL);
+    for (int frame = 0; frame < 20; ++frame) lod.update(5.0);
+    CHECK(lod.detail > TrailLod::MIN_DETAIL && lod.detail < 1.f);
+    for (int frame = 0; frame < 1000; ++frame) lod.update(5.0);
+    CHECK(lod.detail == 1.f);
+}
+
+void testLaunchGovernor() {
+    const int NUM_FIREWORKS = 100;
+    LaunchGovernor disabled;
+    for (int frame = 0; frame < 100; ++frame) disabled.update(1000.0, NUM_FIREWORKS, NUM_FIREWORKS);
+    CHECK(disabled.limit(NUM_FIREWORKS) == NUM_FIREWORKS);
+
+    // the limit shrinks only while no more than it are in flight
+    LaunchGovernor governor(10.0);
+    governor.update(20.0, NUM_FIREWORKS, NUM_FIREWORKS);
+    int limit = governor.limit(NUM_FIREWORKS);
+    CHECK(limit < NUM_FIREWORKS);
+    float fraction = governor.fraction;
+    for (int frame = 0; frame < 100; ++frame) governor.update(20.0, limit + 1, NUM_FIREWORKS);
+    CHECK(governor.fraction == fraction);
+    governor.update(20.0, limit, NUM_FIREWORKS);
+    CHECK(governor.fraction < fraction);
+
+    // never below MIN_FRACTION
+    for (int frame = 0; frame < 10000; ++frame) governor.update(1000.0, 0, NUM_FIREWORKS);
+    CHECK(governor.fraction == LaunchGovernor::MIN_FRACTION);
+    CHECK(governor.limit(NUM_FIREWORKS) == (int) ceil(LaunchGovernor::MIN_FRACTION * NUM_FIREWORKS));
+
+    // with headroom it grows back, but only while the limit is holding launches back
+    for (int frame = 0; frame < 1000; ++frame) governor.update(1.0, 0, NUM_FIREWORKS);
+    CHECK(governor.fraction == LaunchGovernor::MIN_FRACTION);
+    governor.update(1.0, governor.limit(NUM_FIREWORKS), NUM_FIREWORKS);
+    CHECK(governor.fraction > LaunchGovernor::MIN_FRACTION);
+
+    // nothing is held back while it cannot throttle
+    LaunchGovernor unthrottled(10.0);
+    for (int frame = 0; frame < 100; ++frame) unthrottled.update(20.0, 0, NUM_FIREWORKS, false);
+    CHECK(unthrottled.fraction == 1.f);
+}
+
+int main() {
+    testKernelsMatch();
+    testThreadCountsMatch();
+    testParticleBudget();
+    testRetirement();
+    testInstanceCulling();
+    testConfigErrors();
+    testSimulationRejectsOverflow();
+    testPoolFreeList();
+    testFixedTimestepClamps();
+    testTrailLod();
+    testLaunchGovernor();
+
+    if (failures) fprintf(stderr, "%d checks failed\n", failures);
+    else printf("all tests passed\n");
+    return failures ? 1 : 0;
+}